@@ -0,0 +1,635 @@
+#pragma once
+
+#include "Parallel.h"
+#include "Culling.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <random>
+
+struct Aabb
+{
+	glm::vec3 min{ std::numeric_limits<float>::max() };
+	glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+	void Grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+	void Grow(const Aabb& b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+	bool IsEmpty() const { return min.x > max.x; }
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+
+	float SurfaceArea() const
+	{
+		if (IsEmpty()) return 0.0f;
+
+		const glm::vec3 d = max - min;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+};
+
+struct BvhRayHit
+{
+	uint32_t primitive = 0;
+	float t = 0.0f;
+};
+
+// Bounding volume hierarchy over scene instances. Built as a binary binned SAH tree, in parallel below the top levels,
+// then collapsed into 4 wide nodes whose child bounds are stored as structure of arrays so one node is tested with a few SIMD ops.
+class Bvh
+{
+	static constexpr uint32_t BIN_COUNT = 16;
+	static constexpr uint32_t MAX_LEAF_SIZE = 4;
+	static constexpr uint32_t INVALID = ~0u;
+
+	// Refit trees are rebuilt once their SAH cost has grown this much over the freshly built one
+	static constexpr float REBUILD_COST_RATIO = 1.5f;
+
+	struct BuildNode
+	{
+		Aabb bounds;
+		uint32_t left = INVALID;
+		uint32_t right = INVALID;
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+
+	// Slot i is empty when child[i] == INVALID, a leaf over count[i] primitives from child[i] when count[i] > 0, otherwise an inner node
+	struct Node
+	{
+		float minX[4];
+		float minY[4];
+		float minZ[4];
+		float maxX[4];
+		float maxY[4];
+		float maxZ[4];
+		uint32_t child[4];
+		uint32_t count[4];
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_primitiveIndices;
+	std::vector<Aabb> m_primitiveBounds;
+	float m_builtCost = 0.0f;
+	float m_currentCost = 0.0f;
+
+	// Binned SAH split of [first, first + count). Partitions the range and returns the size of the left half, or 0 if it should stay a leaf.
+	// With parallel set the binning is spread over the workers, which only pays off near the top of the tree.
+	static uint32_t Split(std::vector<uint32_t>& indices, const std::vector<Aabb>& bounds, const std::vector<glm::vec3>& centroids, uint32_t first, uint32_t count, Aabb& nodeBounds, bool parallel)
+	{
+		constexpr size_t PARALLEL_CHUNK_SIZE = 16384;
+		const size_t chunkSize = parallel ? PARALLEL_CHUNK_SIZE : std::max<size_t>(count, 1);
+		const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+		struct Bins
+		{
+			Aabb bounds;
+			Aabb centroidBounds;
+			Aabb binBounds[BIN_COUNT];
+			uint32_t binCounts[BIN_COUNT]{};
+		};
+		std::vector<Bins> chunks(chunkCount);
+
+		// Deep in the tree this runs per node, so skip the thread pool entirely when there is a single chunk
+		auto forEachChunk = [&](auto&& body)
+		{
+			if (chunkCount > 1) ParallelFor(chunkCount, 1, body);
+			else body(size_t{ 0 }, chunkCount);
+		};
+
+		forEachChunk([&](size_t begin, size_t end)
+		{
+			for (size_t chunk = begin; chunk < end; chunk++)
+			{
+				for (size_t i = first + chunk * chunkSize; i < first + std::min<size_t>(count, (chunk + 1) * chunkSize); i++)
+				{
+					chunks[chunk].bounds.Grow(bounds[indices[i]]);
+					chunks[chunk].centroidBounds.Grow(centroids[indices[i]]);
+				}
+			}
+		});
+
+		nodeBounds = {};
+		Aabb centroidBounds;
+		for (const Bins& chunk : chunks)
+		{
+			nodeBounds.Grow(chunk.bounds);
+			centroidBounds.Grow(chunk.centroidBounds);
+		}
+		if (count <= 1) return 0;
+
+		const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+		const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+		// Every centroid in the same spot, SAH can't separate them
+		if (extent[axis] <= 0.0f) return count <= MAX_LEAF_SIZE ? 0 : count / 2;
+
+		const float scale = BIN_COUNT / extent[axis];
+		auto binOf = [&](uint32_t primitive)
+		{
+			return std::min(BIN_COUNT - 1, static_cast<uint32_t>((centroids[primitive][axis] - centroidBounds.min[axis]) * scale));
+		};
+
+		forEachChunk([&](size_t begin, size_t end)
+		{
+			for (size_t chunk = begin; chunk < end; chunk++)
+			{
+				for (size_t i = first + chunk * chunkSize; i < first + std::min<size_t>(count, (chunk + 1) * chunkSize); i++)
+				{
+					const uint32_t bin = binOf(indices[i]);
+					chunks[chunk].binBounds[bin].Grow(bounds[indices[i]]);
+					chunks[chunk].binCounts[bin]++;
+				}
+			}
+		});
+
+		Aabb binBounds[BIN_COUNT];
+		uint32_t binCounts[BIN_COUNT]{};
+		for (const Bins& chunk : chunks)
+		{
+			for (uint32_t bin = 0; bin < BIN_COUNT; bin++)
+			{
+				binBounds[bin].Grow(chunk.binBounds[bin]);
+				binCounts[bin] += chunk.binCounts[bin];
+			}
+		}
+
+		// Sweep from the right to get the cost of every split plane
+		float rightAreas[BIN_COUNT]{};
+		uint32_t rightCounts[BIN_COUNT]{};
+		Aabb accumulated;
+		uint32_t accumulatedCount = 0;
+		for (uint32_t bin = BIN_COUNT - 1; bin > 0; bin--)
+		{
+			accumulated.Grow(binBounds[bin]);
+			accumulatedCount += binCounts[bin];
+			rightAreas[bin] = accumulated.SurfaceArea();
+			rightCounts[bin] = accumulatedCount;
+		}
+
+		float bestCost = std::numeric_limits<float>::max();
+		uint32_t bestSplit = 0;
+		accumulated = {};
+		accumulatedCount = 0;
+		for (uint32_t split = 1; split < BIN_COUNT; split++)
+		{
+			accumulated.Grow(binBounds[split - 1]);
+			accumulatedCount += binCounts[split - 1];
+			if (accumulatedCount == 0 || rightCounts[split] == 0) continue;
+
+			const float cost = accumulated.SurfaceArea() * accumulatedCount + rightAreas[split] * rightCounts[split];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = split;
+			}
+		}
+
+		const float leafCost = nodeBounds.SurfaceArea() * count;
+		if (bestSplit == 0 || (count <= MAX_LEAF_SIZE && leafCost <= bestCost)) return 0;
+
+		auto middle = std::partition(indices.begin() + first, indices.begin() + first + count, [&](uint32_t primitive) { return binOf(primitive) < bestSplit; });
+
+		return static_cast<uint32_t>(middle - (indices.begin() + first));
+	}
+
+	static uint32_t BuildRange(std::vector<BuildNode>& nodes, std::vector<uint32_t>& indices, const std::vector<Aabb>& bounds, const std::vector<glm::vec3>& centroids, uint32_t first, uint32_t count)
+	{
+		const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+
+		Aabb nodeBounds;
+		const uint32_t leftCount = Split(indices, bounds, centroids, first, count, nodeBounds, false);
+		nodes[nodeIndex].bounds = nodeBounds;
+		if (leftCount == 0)
+		{
+			nodes[nodeIndex].first = first;
+			nodes[nodeIndex].count = count;
+			return nodeIndex;
+		}
+
+		const uint32_t left = BuildRange(nodes, indices, bounds, centroids, first, leftCount);
+		const uint32_t right = BuildRange(nodes, indices, bounds, centroids, first + leftCount, count - leftCount);
+		nodes[nodeIndex].left = left;
+		nodes[nodeIndex].right = right;
+
+		return nodeIndex;
+	}
+
+	// Pulls grandchildren up until the wide node has four children or only leaves are left
+	uint32_t Collapse(const std::vector<BuildNode>& nodes, uint32_t binaryIndex)
+	{
+		uint32_t children[4] = { INVALID, INVALID, INVALID, INVALID };
+		uint32_t childCount = 0;
+
+		const BuildNode& binary = nodes[binaryIndex];
+		if (binary.count) children[childCount++] = binaryIndex;
+		else
+		{
+			children[childCount++] = binary.left;
+			children[childCount++] = binary.right;
+		}
+
+		while (childCount < 4)
+		{
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (uint32_t i = 0; i < childCount; i++)
+			{
+				if (nodes[children[i]].count) continue;
+
+				const float area = nodes[children[i]].bounds.SurfaceArea();
+				if (area > largestArea)
+				{
+					largestArea = area;
+					largest = static_cast<int>(i);
+				}
+			}
+			if (largest < 0) break;
+
+			const BuildNode& opened = nodes[children[largest]];
+			children[largest] = opened.left;
+			children[childCount++] = opened.right;
+		}
+
+		const uint32_t nodeIndex = static_cast<uint32_t>(m_nodes.size());
+		m_nodes.emplace_back();
+
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			Node& node = m_nodes[nodeIndex];
+			if (i >= childCount)
+			{
+				node.minX[i] = node.minY[i] = node.minZ[i] = std::numeric_limits<float>::max();
+				node.maxX[i] = node.maxY[i] = node.maxZ[i] = -std::numeric_limits<float>::max();
+				node.child[i] = INVALID;
+				node.count[i] = 0;
+				continue;
+			}
+
+			const BuildNode& child = nodes[children[i]];
+			node.minX[i] = child.bounds.min.x; node.minY[i] = child.bounds.min.y; node.minZ[i] = child.bounds.min.z;
+			node.maxX[i] = child.bounds.max.x; node.maxY[i] = child.bounds.max.y; node.maxZ[i] = child.bounds.max.z;
+			node.count[i] = child.count;
+			node.child[i] = child.count ? child.first : INVALID;
+		}
+
+		// Children are emitted after their parent, so refit can walk the array backwards
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			if (nodes[children[i]].count) continue;
+
+			const uint32_t childNode = Collapse(nodes, children[i]);
+			m_nodes[nodeIndex].child[i] = childNode;
+		}
+
+		return nodeIndex;
+	}
+
+	static Aabb SlotBounds(const Node& node, uint32_t i)
+	{
+		Aabb bounds;
+		bounds.min = glm::vec3(node.minX[i], node.minY[i], node.minZ[i]);
+		bounds.max = glm::vec3(node.maxX[i], node.maxY[i], node.maxZ[i]);
+		return bounds;
+	}
+
+	static void SetSlotBounds(Node& node, uint32_t i, const Aabb& bounds)
+	{
+		node.minX[i] = bounds.min.x; node.minY[i] = bounds.min.y; node.minZ[i] = bounds.min.z;
+		node.maxX[i] = bounds.max.x; node.maxY[i] = bounds.max.y; node.maxZ[i] = bounds.max.z;
+	}
+
+	Aabb NodeBounds(const Node& node) const
+	{
+		Aabb bounds;
+		for (uint32_t i = 0; i < 4; i++) if (node.child[i] != INVALID) bounds.Grow(SlotBounds(node, i));
+		return bounds;
+	}
+
+	// SAH cost relative to the root, used to tell when refitting has degraded the tree enough to rebuild
+	float ComputeCost() const
+	{
+		if (m_nodes.empty()) return 0.0f;
+
+		const float rootArea = std::max(NodeBounds(m_nodes[0]).SurfaceArea(), 1e-12f);
+		float cost = 0.0f;
+		for (const Node& node : m_nodes)
+		{
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				if (node.child[i] == INVALID) continue;
+
+				const float area = SlotBounds(node, i).SurfaceArea() / rootArea;
+				cost += node.count[i] ? area * node.count[i] : area;
+			}
+		}
+
+		return cost;
+	}
+
+	// Per slot mask of children whose box is not fully outside the frustum, plus a mask of those fully inside
+	static int TestFrustum(const Node& node, const Frustum& frustum, int& insideMask)
+	{
+		int intersectMask = 0xF;
+		insideMask = 0xF;
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			const float* px = plane.x > 0.0f ? node.maxX : node.minX;
+			const float* py = plane.y > 0.0f ? node.maxY : node.minY;
+			const float* pz = plane.z > 0.0f ? node.maxZ : node.minZ;
+			const float* nx = plane.x > 0.0f ? node.minX : node.maxX;
+			const float* ny = plane.y > 0.0f ? node.minY : node.maxY;
+			const float* nz = plane.z > 0.0f ? node.minZ : node.maxZ;
+#if defined(CULLING_AVX) || defined(CULLING_SSE)
+			const __m128 a = _mm_set1_ps(plane.x);
+			const __m128 b = _mm_set1_ps(plane.y);
+			const __m128 c = _mm_set1_ps(plane.z);
+			const __m128 d = _mm_set1_ps(plane.w);
+			const __m128 farthest = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(px)), _mm_mul_ps(b, _mm_loadu_ps(py))), _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(pz)), d));
+			const __m128 nearest = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(nx)), _mm_mul_ps(b, _mm_loadu_ps(ny))), _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(nz)), d));
+			intersectMask &= _mm_movemask_ps(_mm_cmpge_ps(farthest, _mm_setzero_ps()));
+			insideMask &= _mm_movemask_ps(_mm_cmpge_ps(nearest, _mm_setzero_ps()));
+#else
+			for (int i = 0; i < 4; i++)
+			{
+				if (plane.x * px[i] + plane.y * py[i] + plane.z * pz[i] + plane.w < 0.0f) intersectMask &= ~(1 << i);
+				if (plane.x * nx[i] + plane.y * ny[i] + plane.z * nz[i] + plane.w < 0.0f) insideMask &= ~(1 << i);
+			}
+#endif
+		}
+		insideMask &= intersectMask;
+
+		return intersectMask;
+	}
+
+	void AppendSubtree(uint32_t nodeIndex, std::vector<uint32_t>& out) const
+	{
+		const Node& node = m_nodes[nodeIndex];
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			if (node.child[i] == INVALID) continue;
+
+			if (node.count[i]) out.insert(out.end(), m_primitiveIndices.begin() + node.child[i], m_primitiveIndices.begin() + node.child[i] + node.count[i]);
+			else AppendSubtree(node.child[i], out);
+		}
+	}
+
+public:
+	// Rebuilds from scratch. The top of the tree is split serially with parallel binning, the subtrees below are built on worker threads.
+	void Build(const std::vector<Aabb>& primitiveBounds)
+	{
+		constexpr uint32_t MIN_TASK_SIZE = 1024;
+
+		m_primitiveBounds = primitiveBounds;
+		m_nodes.clear();
+		m_primitiveIndices.resize(primitiveBounds.size());
+		for (uint32_t i = 0; i < m_primitiveIndices.size(); i++) m_primitiveIndices[i] = i;
+		if (primitiveBounds.empty()) return;
+
+		std::vector<glm::vec3> centroids(primitiveBounds.size());
+		for (size_t i = 0; i < primitiveBounds.size(); i++) centroids[i] = primitiveBounds[i].Center();
+
+		// Ranges still to be built, and the top node (and side) each one hangs off
+		struct Task
+		{
+			uint32_t first;
+			uint32_t count;
+			uint32_t parent;
+			bool isRight;
+			std::vector<BuildNode> nodes;
+		};
+		std::vector<Task> tasks;
+		tasks.push_back({ 0, static_cast<uint32_t>(primitiveBounds.size()), INVALID, false, {} });
+		std::vector<BuildNode> topNodes;
+
+		// Split the largest range until there is enough work to go around
+		const size_t wantedTasks = std::max<size_t>(1, std::thread::hardware_concurrency()) * 4;
+		while (tasks.size() < wantedTasks)
+		{
+			Task& largest = *std::ranges::max_element(tasks, {}, &Task::count);
+			if (largest.count < MIN_TASK_SIZE) break;
+
+			Aabb nodeBounds;
+			const uint32_t leftCount = Split(m_primitiveIndices, primitiveBounds, centroids, largest.first, largest.count, nodeBounds, true);
+			if (leftCount == 0) break;
+
+			const uint32_t topIndex = static_cast<uint32_t>(topNodes.size());
+			topNodes.push_back({ nodeBounds });
+			if (largest.parent != INVALID) (largest.isRight ? topNodes[largest.parent].right : topNodes[largest.parent].left) = topIndex;
+
+			const Task right = { largest.first + leftCount, largest.count - leftCount, topIndex, true, {} };
+			largest = { largest.first, leftCount, topIndex, false, {} };
+			tasks.push_back(right);
+		}
+
+		ParallelFor(tasks.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t t = begin; t < end; t++) BuildRange(tasks[t].nodes, m_primitiveIndices, primitiveBounds, centroids, tasks[t].first, tasks[t].count);
+		});
+
+		// Stitch the task trees in below the top nodes
+		std::vector<BuildNode> nodes = std::move(topNodes);
+		for (const Task& task : tasks)
+		{
+			const uint32_t offset = static_cast<uint32_t>(nodes.size());
+			for (BuildNode node : task.nodes)
+			{
+				if (!node.count)
+				{
+					node.left += offset;
+					node.right += offset;
+				}
+				nodes.push_back(node);
+			}
+
+			if (task.parent != INVALID) (task.isRight ? nodes[task.parent].right : nodes[task.parent].left) = offset;
+		}
+
+		m_nodes.reserve(nodes.size() / 2 + 1);
+		Collapse(nodes, 0);
+
+		m_builtCost = ComputeCost();
+		m_currentCost = m_builtCost;
+	}
+
+	// Updates the bounds in place without changing the topology. Returns false when the tree has degraded and should be rebuilt.
+	bool Refit(const std::vector<Aabb>& primitiveBounds)
+	{
+		m_primitiveBounds = primitiveBounds;
+
+		for (size_t n = m_nodes.size(); n-- > 0;)
+		{
+			Node& node = m_nodes[n];
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				if (node.child[i] == INVALID) continue;
+
+				Aabb bounds;
+				if (node.count[i])
+				{
+					for (uint32_t p = node.child[i]; p < node.child[i] + node.count[i]; p++) bounds.Grow(m_primitiveBounds[m_primitiveIndices[p]]);
+				}
+				else bounds = NodeBounds(m_nodes[node.child[i]]);
+
+				SetSlotBounds(node, i, bounds);
+			}
+		}
+
+		m_currentCost = ComputeCost();
+
+		return m_currentCost <= m_builtCost * REBUILD_COST_RATIO;
+	}
+
+	// Refits while the tree stays good, rebuilds when the primitive count changed or the quality dropped
+	void Update(const std::vector<Aabb>& primitiveBounds)
+	{
+		if (primitiveBounds.size() != m_primitiveIndices.size() || m_nodes.empty() || !Refit(primitiveBounds)) Build(primitiveBounds);
+	}
+
+	size_t GetPrimitiveCount() const { return m_primitiveIndices.size(); }
+
+	// Appends every primitive whose box touches the frustum. Subtrees entirely inside skip further plane tests.
+	void CullFrustum(const Frustum& frustum, std::vector<uint32_t>& visible) const
+	{
+		visible.clear();
+		if (m_nodes.empty()) return;
+
+		std::vector<uint32_t> stack = { 0 };
+
+		while (!stack.empty())
+		{
+			const Node& node = m_nodes[stack.back()];
+			stack.pop_back();
+
+			int insideMask = 0;
+			int mask = TestFrustum(node, frustum, insideMask);
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				if (!(mask & (1 << i)) || node.child[i] == INVALID) continue;
+
+				if (node.count[i])
+				{
+					for (uint32_t p = node.child[i]; p < node.child[i] + node.count[i]; p++)
+					{
+						const uint32_t primitive = m_primitiveIndices[p];
+						if (insideMask & (1 << i)) visible.push_back(primitive);
+						else
+						{
+							const Aabb& bounds = m_primitiveBounds[primitive];
+							bool inside = true;
+							for (const glm::vec4& plane : frustum.planes)
+							{
+								const glm::vec3 farthest(plane.x > 0.0f ? bounds.max.x : bounds.min.x, plane.y > 0.0f ? bounds.max.y : bounds.min.y, plane.z > 0.0f ? bounds.max.z : bounds.min.z);
+								inside &= glm::dot(glm::vec3(plane), farthest) + plane.w >= 0.0f;
+							}
+							if (inside) visible.push_back(primitive);
+						}
+					}
+				}
+				else if (insideMask & (1 << i)) AppendSubtree(node.child[i], visible);
+				else stack.push_back(node.child[i]);
+			}
+		}
+	}
+
+	// Nearest primitive box hit along the ray, for picking
+	std::optional<BvhRayHit> Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = std::numeric_limits<float>::max()) const
+	{
+		if (m_nodes.empty()) return std::nullopt;
+
+		const glm::vec3 invDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		auto slab = [&](const glm::vec3& bmin, const glm::vec3& bmax, float tMax)
+		{
+			const glm::vec3 t0 = (bmin - origin) * invDirection;
+			const glm::vec3 t1 = (bmax - origin) * invDirection;
+			const glm::vec3 tNear = glm::min(t0, t1);
+			const glm::vec3 tFar = glm::max(t0, t1);
+			const float enter = std::max({ tNear.x, tNear.y, tNear.z, 0.0f });
+			const float exit = std::min({ tFar.x, tFar.y, tFar.z, tMax });
+			return enter <= exit ? enter : -1.0f;
+		};
+
+		std::optional<BvhRayHit> closest;
+		float tMax = maxDistance;
+
+		std::vector<uint32_t> stack = { 0 };
+
+		while (!stack.empty())
+		{
+			const Node& node = m_nodes[stack.back()];
+			stack.pop_back();
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				if (node.child[i] == INVALID) continue;
+				if (slab({ node.minX[i], node.minY[i], node.minZ[i] }, { node.maxX[i], node.maxY[i], node.maxZ[i] }, tMax) < 0.0f) continue;
+
+				if (!node.count[i])
+				{
+					stack.push_back(node.child[i]);
+					continue;
+				}
+
+				for (uint32_t p = node.child[i]; p < node.child[i] + node.count[i]; p++)
+				{
+					const uint32_t primitive = m_primitiveIndices[p];
+					const float t = slab(m_primitiveBounds[primitive].min, m_primitiveBounds[primitive].max, tMax);
+					if (t < 0.0f) continue;
+
+					tMax = t;
+					closest = BvhRayHit{ primitive, t };
+				}
+			}
+		}
+
+		return closest;
+	}
+};
+
+// Culls objectCount random boxes through the BVH the renderer culls with, against a fixed frustum, and reports throughput
+// in objects per microsecond. The tree is built once, outside the timing.
+inline double BenchmarkFrustumCulling(size_t objectCount, int iterations, size_t& visibleCount)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> radius(0.1f, 2.0f);
+
+	std::vector<Aabb> bounds(objectCount);
+	for (Aabb& box : bounds)
+	{
+		const glm::vec3 center(position(rng), position(rng), position(rng));
+		const glm::vec3 extent(radius(rng));
+		box.min = center - extent;
+		box.max = center + extent;
+	}
+
+	// Looking down -z from the origin with a 90 degree fov, near 0.1, far 100
+	glm::mat4 viewProj(0.0f);
+	viewProj[0][0] = 1.0f;
+	viewProj[1][1] = 1.0f;
+	viewProj[2][2] = 100.0f / (0.1f - 100.0f);
+	viewProj[2][3] = -1.0f;
+	viewProj[3][2] = 100.0f * 0.1f / (0.1f - 100.0f);
+	const Frustum frustum = Frustum::FromViewProj(viewProj);
+
+	Bvh bvh;
+	bvh.Build(bounds);
+
+	std::vector<uint32_t> visible;
+	visible.reserve(objectCount);
+	bvh.CullFrustum(frustum, visible);
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) bvh.CullFrustum(frustum, visible);
+	const double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+	visibleCount = visible.size();
+
+	return static_cast<double>(objectCount) * iterations / microseconds;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#if defined(__AVX__) || defined(__AVX2__)
+#include <immintrin.h>
+#define CULLING_AVX 1
+#elif defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+// Inward facing planes, xyz normalized so plane distance is in world units
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	// Gribb/Hartmann extraction for a zero to one depth range
+	static Frustum FromViewProj(const glm::mat4& viewProj)
+	{
+		auto row = [&viewProj](int i) { return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+		const glm::vec4 r0 = row(0);
+		const glm::vec4 r1 = row(1);
+		const glm::vec4 r2 = row(2);
+		const glm::vec4 r3 = row(3);
+
+		Frustum frustum{};
+		frustum.planes[0] = r3 + r0;
+		frustum.planes[1] = r3 - r0;
+		frustum.planes[2] = r3 + r1;
+		frustum.planes[3] = r3 - r1;
+		frustum.planes[4] = r2;
+		frustum.planes[5] = r3 - r2;
+		for (glm::vec4& plane : frustum.planes) plane /= glm::length(glm::vec3(plane));
+
+		return frustum;
+	}
+};
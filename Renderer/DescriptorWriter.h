@@ -0,0 +1,220 @@
+#pragma once
+
+#include "Hash.h"
+#include "LayoutCache.h"
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include <unordered_map>
+
+// One descriptor as update templates read it. Template data is an array of these indexed by binding number, bindings the
+// template doesn't cover just leave their element unused. The C types keep the union trivial.
+union DescriptorData
+{
+	VkDescriptorBufferInfo buffer;
+	VkDescriptorImageInfo image;
+	VkBufferView texelBuffer;
+	VkAccelerationStructureKHR accelerationStructure;
+};
+
+inline DescriptorData BufferDescriptor(vk::Buffer buffer, vk::DeviceSize offset = 0, vk::DeviceSize range = vk::WholeSize)
+{
+	DescriptorData data{};
+	data.buffer = vk::DescriptorBufferInfo{ buffer, offset, range };
+	return data;
+}
+
+inline DescriptorData ImageDescriptor(vk::ImageView imageView, vk::ImageLayout imageLayout, vk::Sampler sampler = nullptr)
+{
+	DescriptorData data{};
+	data.image = vk::DescriptorImageInfo{ sampler, imageView, imageLayout };
+	return data;
+}
+
+inline DescriptorData SamplerDescriptor(vk::Sampler sampler)
+{
+	return ImageDescriptor(nullptr, vk::ImageLayout::eUndefined, sampler);
+}
+
+// Records descriptor updates and applies them together. Whole sets go through update templates made once per set layout,
+// so an update is one call reading a flat array instead of a WriteDescriptorSet per binding. Single descriptors, the slots of
+// bindless arrays, are collected into one updateDescriptorSets call per flush.
+// Templates cover the bindings with exactly one descriptor, arrays are left to Write.
+class DescriptorWriter
+{
+	struct TemplateUpdate
+	{
+		vk::DescriptorSet set;
+		vk::DescriptorUpdateTemplate updateTemplate;
+		size_t dataOffset;
+	};
+
+	const vk::raii::Device* m_device = nullptr;
+	LayoutCache* m_layoutCache = nullptr;
+
+	std::mutex m_mutex;
+	std::unordered_map<uint64_t, vk::raii::DescriptorUpdateTemplate> m_templates; // By set layout, and pipeline layout and set for push descriptors
+	std::unordered_map<vk::DescriptorUpdateTemplate, size_t> m_templateDataCounts; // Highest binding covered plus one
+
+	std::vector<TemplateUpdate> m_templateUpdates;
+	std::vector<DescriptorData> m_templateData;
+	std::vector<vk::WriteDescriptorSet> m_writes;
+	std::vector<DescriptorData> m_writeData; // One per write, pointed at when flushing as the vector may still grow before that
+
+	size_t m_flushCount = 0;
+
+	// Callers hold m_mutex
+	size_t GetDataCountLocked(vk::DescriptorUpdateTemplate updateTemplate) const
+	{
+		const auto it = m_templateDataCounts.find(updateTemplate);
+		if (it == m_templateDataCounts.end()) throw std::runtime_error("update template doesn't come from this writer");
+		return it->second;
+	}
+
+public:
+	DescriptorWriter() = default;
+	DescriptorWriter(const DescriptorWriter&) = delete;
+	DescriptorWriter& operator=(const DescriptorWriter&) = delete;
+
+	// Both have to outlive the writer, layouts are looked up in the cache to build templates
+	void Init(const vk::raii::Device& device, LayoutCache& layoutCache)
+	{
+		m_device = &device;
+		m_layoutCache = &layoutCache;
+	}
+
+	// The template for a set of layout, made on first use. When the set is layout's push descriptor set the template pushes
+	// at bindPoint, and goes to PushDescriptorSet rather than WriteSet.
+	vk::DescriptorUpdateTemplate GetTemplate(const ShaderLayout& layout, uint32_t set, vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eGraphics)
+	{
+		const vk::DescriptorSetLayout setLayout = layout.setLayouts.at(set);
+		const bool push = set == layout.pushDescriptorSet;
+
+		uint64_t key = HashValue(static_cast<VkDescriptorSetLayout>(setLayout));
+		if (push) key = HashValue(set, HashValue(static_cast<VkPipelineLayout>(layout.pipelineLayout), key));
+
+		const std::span<const vk::DescriptorSetLayoutBinding> bindings = m_layoutCache->GetSetLayoutBindings(setLayout);
+		if (bindings.empty()) throw std::runtime_error("set layout isn't from the layout cache or has no bindings");
+
+		std::lock_guard lock(m_mutex);
+		auto it = m_templates.find(key);
+		if (it != m_templates.end()) return *it->second;
+
+		std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+		size_t dataCount = 0;
+		for (const vk::DescriptorSetLayoutBinding& binding : bindings)
+		{
+			if (binding.descriptorCount != 1) continue;
+			entries.emplace_back(binding.binding, 0, 1, binding.descriptorType, binding.binding * sizeof(DescriptorData), sizeof(DescriptorData));
+			dataCount = std::max<size_t>(dataCount, binding.binding + 1);
+		}
+		if (entries.empty()) throw std::runtime_error("set has only arrays, there is nothing to template");
+
+		vk::DescriptorUpdateTemplateCreateInfo templateInfo{};
+		templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+		templateInfo.pDescriptorUpdateEntries = entries.data();
+		if (push)
+		{
+			templateInfo.templateType = vk::DescriptorUpdateTemplateType::ePushDescriptorsKHR;
+			templateInfo.pipelineBindPoint = bindPoint;
+			templateInfo.pipelineLayout = layout.pipelineLayout;
+			templateInfo.set = set;
+		}
+		else
+		{
+			templateInfo.templateType = vk::DescriptorUpdateTemplateType::eDescriptorSet;
+			templateInfo.descriptorSetLayout = setLayout;
+		}
+		it = m_templates.emplace(key, vk::raii::DescriptorUpdateTemplate{ *m_device, templateInfo }).first;
+		m_templateDataCounts.emplace(*it->second, dataCount);
+		return *it->second;
+	}
+
+	// Stages every binding the template covers, data is indexed by binding and copied
+	void WriteSet(vk::DescriptorSet set, vk::DescriptorUpdateTemplate updateTemplate, std::span<const DescriptorData> data)
+	{
+		std::lock_guard lock(m_mutex);
+		const size_t dataCount = GetDataCountLocked(updateTemplate);
+		if (data.size() < dataCount) throw std::runtime_error("template data doesn't reach the template's last binding");
+
+		m_templateUpdates.push_back({ set, updateTemplate, m_templateData.size() });
+		m_templateData.insert(m_templateData.end(), data.begin(), data.begin() + dataCount);
+	}
+
+	// Stages a single descriptor, typically one slot of a bindless array
+	void Write(vk::DescriptorSet set, uint32_t binding, uint32_t arrayElement, vk::DescriptorType type, const DescriptorData& data)
+	{
+		if (type == vk::DescriptorType::eAccelerationStructureKHR) throw std::runtime_error("acceleration structures only go through templates");
+
+		std::lock_guard lock(m_mutex);
+		m_writes.emplace_back(set, binding, arrayElement, 1, type);
+		m_writeData.push_back(data);
+	}
+
+	// Applies everything staged, template updates first. Sets written must not be in use by the GPU, except for bindings
+	// created update after bind.
+	void Flush()
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_templateUpdates.empty() && m_writes.empty()) return;
+
+		// The C entry point, the wrapper wants the data as one typed object
+		const auto& dispatcher = *m_device->getDispatcher();
+		for (const TemplateUpdate& update : m_templateUpdates)
+			dispatcher.vkUpdateDescriptorSetWithTemplate(static_cast<VkDevice>(**m_device), static_cast<VkDescriptorSet>(update.set), static_cast<VkDescriptorUpdateTemplate>(update.updateTemplate), m_templateData.data() + update.dataOffset);
+
+		for (size_t i = 0; i < m_writes.size(); i++)
+		{
+			vk::WriteDescriptorSet& write = m_writes[i];
+			DescriptorData& data = m_writeData[i];
+			switch (write.descriptorType)
+			{
+			case vk::DescriptorType::eUniformBuffer:
+			case vk::DescriptorType::eStorageBuffer:
+			case vk::DescriptorType::eUniformBufferDynamic:
+			case vk::DescriptorType::eStorageBufferDynamic:
+				write.pBufferInfo = reinterpret_cast<const vk::DescriptorBufferInfo*>(&data.buffer);
+				break;
+			case vk::DescriptorType::eUniformTexelBuffer:
+			case vk::DescriptorType::eStorageTexelBuffer:
+				write.pTexelBufferView = reinterpret_cast<const vk::BufferView*>(&data.texelBuffer);
+				break;
+			default:
+				write.pImageInfo = reinterpret_cast<const vk::DescriptorImageInfo*>(&data.image);
+				break;
+			}
+		}
+		if (!m_writes.empty()) m_device->updateDescriptorSets(m_writes, {});
+
+		m_templateUpdates.clear();
+		m_templateData.clear();
+		m_writes.clear();
+		m_writeData.clear();
+		m_flushCount++;
+	}
+
+	// Records a push of every binding the template covers, data is indexed by binding and read right away
+	static void PushDescriptorSet(const vk::raii::CommandBuffer& commandBuffer, vk::DescriptorUpdateTemplate updateTemplate, vk::PipelineLayout layout, uint32_t set, std::span<const DescriptorData> data)
+	{
+		commandBuffer.getDispatcher()->vkCmdPushDescriptorSetWithTemplateKHR(static_cast<VkCommandBuffer>(*commandBuffer), static_cast<VkDescriptorUpdateTemplate>(updateTemplate), static_cast<VkPipelineLayout>(layout), set, data.data());
+	}
+
+	size_t GetTemplateCount()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_templates.size();
+	}
+
+	size_t GetFlushCount()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_flushCount;
+	}
+};
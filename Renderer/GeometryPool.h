@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+// First-fit free list over a linear range. Used to sub-allocate the shared vertex and index buffers.
+class RangeAllocator
+{
+	struct FreeBlock
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	std::vector<FreeBlock> m_freeBlocks; // Sorted by offset, never adjacent
+	uint64_t m_capacity = 0;
+	uint64_t m_used = 0;
+
+public:
+	explicit RangeAllocator(uint64_t capacity = 0) { Reset(capacity); }
+
+	void Reset(uint64_t capacity)
+	{
+		m_capacity = capacity;
+		m_used = 0;
+		m_freeBlocks.clear();
+		if (capacity) m_freeBlocks.push_back({ 0, capacity });
+	}
+
+	std::optional<uint64_t> Allocate(uint64_t size, uint64_t alignment = 1)
+	{
+		if (size == 0) return std::nullopt;
+
+		for (size_t i = 0; i < m_freeBlocks.size(); i++)
+		{
+			FreeBlock& block = m_freeBlocks[i];
+
+			const uint64_t alignedOffset = (block.offset + alignment - 1) / alignment * alignment;
+			const uint64_t padding = alignedOffset - block.offset;
+			if (block.size < padding + size) continue;
+
+			const uint64_t blockEnd = block.offset + block.size;
+			const uint64_t allocationEnd = alignedOffset + size;
+
+			// Keep the padding in front as its own free block so nothing leaks
+			if (padding)
+			{
+				block.size = padding;
+				if (allocationEnd < blockEnd) m_freeBlocks.insert(m_freeBlocks.begin() + i + 1, { allocationEnd, blockEnd - allocationEnd });
+			}
+			else if (allocationEnd < blockEnd)
+			{
+				block.offset = allocationEnd;
+				block.size = blockEnd - allocationEnd;
+			}
+			else m_freeBlocks.erase(m_freeBlocks.begin() + i);
+
+			m_used += size;
+			return alignedOffset;
+		}
+
+		return std::nullopt;
+	}
+
+	void Free(uint64_t offset, uint64_t size)
+	{
+		if (size == 0) return;
+
+		auto next = std::ranges::lower_bound(m_freeBlocks, offset, {}, &FreeBlock::offset);
+		auto inserted = m_freeBlocks.insert(next, { offset, size });
+
+		// Merge with the following block
+		if (inserted + 1 != m_freeBlocks.end() && inserted->offset + inserted->size == (inserted + 1)->offset)
+		{
+			inserted->size += (inserted + 1)->size;
+			m_freeBlocks.erase(inserted + 1);
+		}
+
+		// Merge with the preceding block
+		if (inserted != m_freeBlocks.begin() && (inserted - 1)->offset + (inserted - 1)->size == inserted->offset)
+		{
+			(inserted - 1)->size += inserted->size;
+			m_freeBlocks.erase(inserted);
+		}
+
+		m_used -= size;
+	}
+
+	uint64_t GetCapacity() const { return m_capacity; }
+	uint64_t GetUsed() const { return m_used; }
+};
+
+// Location of one mesh inside the geometry pool. Everything drawIndexed needs, plus what is needed to free it again.
+// firstIndex is in units of indexSize, which is picked per mesh (1, 2 or 4 bytes).
+struct MeshRange
+{
+	uint32_t firstIndex = 0;
+	int32_t vertexOffset = 0;
+	uint32_t indexCount = 0;
+	uint32_t vertexCount = 0;
+	uint32_t indexSize = 2;
+};
+
+template<typename VertexT>
+struct MeshPart
+{
+	std::vector<VertexT> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// Splits a mesh into parts that each reference at most maxVertices vertices, so every part can use 16 bit indices.
+// Triangles are kept in order, vertices shared across a part boundary are duplicated.
+template<typename VertexT>
+std::vector<MeshPart<VertexT>> SplitMesh(const std::vector<VertexT>& vertices, const std::vector<uint32_t>& indices, size_t maxVertices = 65536)
+{
+	std::vector<MeshPart<VertexT>> parts(1);
+	std::vector<uint32_t> localIndex(vertices.size(), ~0u);
+	std::vector<uint32_t> usedVertices;
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		size_t newVertices = 0;
+		for (size_t c = 0; c < 3; c++) newVertices += localIndex[indices[i + c]] == ~0u;
+
+		if (parts.back().vertices.size() + newVertices > maxVertices)
+		{
+			for (uint32_t v : usedVertices) localIndex[v] = ~0u;
+			usedVertices.clear();
+			parts.emplace_back();
+		}
+
+		MeshPart<VertexT>& part = parts.back();
+		for (size_t c = 0; c < 3; c++)
+		{
+			const uint32_t v = indices[i + c];
+			if (localIndex[v] == ~0u)
+			{
+				localIndex[v] = static_cast<uint32_t>(part.vertices.size());
+				part.vertices.push_back(vertices[v]);
+				usedVertices.push_back(v);
+			}
+			part.indices.push_back(localIndex[v]);
+		}
+	}
+
+	return parts;
+}
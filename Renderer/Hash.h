@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// 64 bit FNV-1a. Used for cache keys and file checksums, not for anything security related.
+constexpr uint64_t HASH_SEED = 0xcbf29ce484222325ull;
+
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = HASH_SEED)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+inline uint64_t HashBytes(std::span<const std::byte> bytes, uint64_t hash = HASH_SEED) { return HashBytes(bytes.data(), bytes.size(), hash); }
+inline uint64_t HashString(std::string_view text, uint64_t hash = HASH_SEED) { return HashBytes(text.data(), text.size(), hash); }
+
+template<typename T>
+uint64_t HashValue(const T& value, uint64_t hash = HASH_SEED) { return HashBytes(&value, sizeof(T), hash); }
+
+inline uint64_t HashCombine(uint64_t hash, uint64_t value) { return HashValue(value, hash); }
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+class JobSystem;
+
+struct Job
+{
+	std::function<void()> function;
+	class JobCounter* signal = nullptr;
+};
+
+// Counts unfinished jobs. Jobs can be made to wait for a counter to reach zero, which is how dependencies are expressed.
+class JobCounter
+{
+	friend class JobSystem;
+
+	std::atomic<uint32_t> m_pending{ 0 };
+
+	// Dropping to zero and parking a dependent job both happen under the lock, so no dependent is ever missed
+	std::mutex m_mutex;
+	std::vector<Job*> m_dependents;
+
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Chase-Lev work stealing deque. The owning thread pushes and pops at the bottom, other threads steal from the top.
+class JobDeque
+{
+	static constexpr int64_t CAPACITY = 4096;
+	static constexpr int64_t MASK = CAPACITY - 1;
+
+	alignas(64) std::atomic<int64_t> m_top{ 0 };
+	alignas(64) std::atomic<int64_t> m_bottom{ 0 };
+	alignas(64) std::array<std::atomic<Job*>, CAPACITY> m_jobs{};
+
+public:
+	// Owner only. Returns false when full, the caller then runs the job itself.
+	bool Push(Job* job)
+	{
+		const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+		const int64_t top = m_top.load(std::memory_order_acquire);
+		if (bottom - top >= CAPACITY) return false;
+
+		m_jobs[bottom & MASK].store(job, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// Owner only
+	Job* Pop()
+	{
+		const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = m_top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job* job = m_jobs[bottom & MASK].load(std::memory_order_relaxed);
+		if (top == bottom)
+		{
+			// Last job, race the thieves for it
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+
+		return job;
+	}
+
+	// Any thread
+	Job* Steal()
+	{
+		int64_t top = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+		if (top >= bottom) return nullptr;
+
+		Job* job = m_jobs[top & MASK].load(std::memory_order_relaxed);
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+
+		return job;
+	}
+};
+
+// One pool of workers sized to the machine, shared by everything that wants to run in parallel.
+// Every worker and the thread that created the pool own a deque; idle threads steal from the others.
+// Threads outside the pool have no deque and run what they schedule inline.
+class JobSystem
+{
+	static constexpr uint32_t NO_WORKER = ~0u;
+
+	static inline thread_local uint32_t t_workerIndex = NO_WORKER;
+
+	std::vector<std::unique_ptr<JobDeque>> m_deques;
+	std::vector<std::jthread> m_workers;
+
+	// Jobs sitting in any deque, idle workers sleep on it
+	std::atomic<uint32_t> m_queuedJobs{ 0 };
+	std::atomic<bool> m_stopping{ false };
+
+	JobSystem()
+	{
+		const uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+		for (uint32_t i = 0; i < threadCount; i++) m_deques.push_back(std::make_unique<JobDeque>());
+
+		t_workerIndex = 0;
+		for (uint32_t i = 1; i < threadCount; i++) m_workers.emplace_back([this, i]() { WorkerLoop(i); });
+	}
+
+	~JobSystem()
+	{
+		m_stopping = true;
+		m_queuedJobs++;
+		m_queuedJobs.notify_all();
+		m_workers.clear();
+	}
+
+	void WorkerLoop(uint32_t workerIndex)
+	{
+		t_workerIndex = workerIndex;
+		while (!m_stopping)
+		{
+			if (RunOne()) continue;
+
+			const uint32_t queued = m_queuedJobs.load();
+			if (queued == 0) m_queuedJobs.wait(0);
+			else std::this_thread::yield();
+		}
+	}
+
+	void Enqueue(Job* job)
+	{
+		// Counted before the push so a thief can never take it below zero
+		m_queuedJobs++;
+		if (t_workerIndex == NO_WORKER || !m_deques[t_workerIndex]->Push(job))
+		{
+			m_queuedJobs--;
+			Execute(job);
+			return;
+		}
+
+		m_queuedJobs.notify_one();
+	}
+
+	void Execute(Job* job)
+	{
+		job->function();
+
+		JobCounter* signal = job->signal;
+		delete job;
+		if (!signal) return;
+
+		std::vector<Job*> released;
+		{
+			std::lock_guard lock(signal->m_mutex);
+			if (signal->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) released.swap(signal->m_dependents);
+		}
+		for (Job* dependent : released) Enqueue(dependent);
+	}
+
+	// Own deque first, then steal starting from the next thread over
+	bool RunOne()
+	{
+		if (t_workerIndex == NO_WORKER) return false;
+
+		Job* job = m_deques[t_workerIndex]->Pop();
+		for (size_t i = 1; !job && i < m_deques.size(); i++) job = m_deques[(t_workerIndex + i) % m_deques.size()]->Steal();
+		if (!job) return false;
+
+		m_queuedJobs--;
+		Execute(job);
+
+		return true;
+	}
+
+public:
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Created on first use, the calling thread becomes the pool's main thread
+	static JobSystem& Get()
+	{
+		static JobSystem jobSystem;
+		return jobSystem;
+	}
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_deques.size()); }
+
+	// Index of the calling thread inside the pool, 0 for the main thread. Useful for per-thread scratch data, only meaningful on pool threads.
+	static uint32_t GetThreadIndex() { return t_workerIndex == NO_WORKER ? 0 : t_workerIndex; }
+
+	// Queues function. signal, if given, stays non-zero until it has run. With dependency set it doesn't start before that counter is done.
+	void Schedule(std::function<void()> function, JobCounter* signal = nullptr, JobCounter* dependency = nullptr)
+	{
+		Job* job = new Job{ std::move(function), signal };
+		if (signal) signal->m_pending.fetch_add(1, std::memory_order_relaxed);
+
+		if (dependency)
+		{
+			std::lock_guard lock(dependency->m_mutex);
+			if (dependency->m_pending.load(std::memory_order_acquire) != 0)
+			{
+				dependency->m_dependents.push_back(job);
+				return;
+			}
+		}
+
+		Enqueue(job);
+	}
+
+	// Runs other jobs until counter is done instead of blocking
+	void Wait(JobCounter& counter)
+	{
+		while (!counter.IsDone())
+		{
+			if (!RunOne()) std::this_thread::yield();
+		}
+
+		// The last job may still be holding the lock it dropped the counter to zero under
+		std::lock_guard lock(counter.m_mutex);
+	}
+};
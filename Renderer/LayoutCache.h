@@ -0,0 +1,199 @@
+#pragma once
+
+#include "Hash.h"
+#include "ShaderReflection.h"
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <cstdint>
+#include <algorithm>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+constexpr uint32_t NO_PUSH_DESCRIPTOR_SET = ~0u;
+
+// A pipeline layout built from reflection, with the set layouts and push constant ranges it was made of.
+// Owned by the cache, so copies are cheap and stay valid as long as it does.
+struct ShaderLayout
+{
+	vk::PipelineLayout pipelineLayout;
+	std::vector<vk::DescriptorSetLayout> setLayouts; // By set number, sets the shader doesn't use get an empty layout
+	std::vector<vk::PushConstantRange> pushConstantRanges;
+	uint32_t pushDescriptorSet = NO_PUSH_DESCRIPTOR_SET; // Pushed with the commands rather than allocated (VK_KHR_push_descriptor)
+};
+
+// Set and pipeline layouts by signature, the exact words that describe them. Equal signatures return the same handle, so
+// shaders declaring the same interface get the same layouts and can bind each other's descriptor sets without rebinding.
+class LayoutCache
+{
+	using Signature = std::vector<uint32_t>;
+
+	struct SignatureHash
+	{
+		size_t operator()(const Signature& signature) const { return static_cast<size_t>(HashBytes(signature.data(), signature.size() * sizeof(uint32_t))); }
+	};
+
+	const vk::raii::Device* m_device = nullptr;
+
+	std::mutex m_mutex;
+	std::unordered_map<Signature, vk::raii::DescriptorSetLayout, SignatureHash> m_setLayouts;
+	std::unordered_map<Signature, vk::raii::PipelineLayout, SignatureHash> m_pipelineLayouts;
+	std::unordered_map<vk::DescriptorSetLayout, std::vector<vk::DescriptorSetLayoutBinding>> m_setLayoutBindings;
+
+	// Callers hold m_mutex
+	vk::DescriptorSetLayout GetSetLayoutLocked(std::span<const vk::DescriptorSetLayoutBinding> bindings, std::span<const vk::DescriptorBindingFlags> bindingFlags, bool pushDescriptor)
+	{
+		Signature signature;
+		signature.push_back(pushDescriptor ? 1 : 0);
+		for (size_t i = 0; i < bindings.size(); i++)
+		{
+			const vk::DescriptorSetLayoutBinding& binding = bindings[i];
+			if (binding.pImmutableSamplers) throw std::runtime_error("layout cache doesn't take immutable samplers");
+
+			signature.push_back(binding.binding);
+			signature.push_back(static_cast<uint32_t>(binding.descriptorType));
+			signature.push_back(binding.descriptorCount);
+			signature.push_back(static_cast<uint32_t>(binding.stageFlags));
+			signature.push_back(i < bindingFlags.size() ? static_cast<uint32_t>(bindingFlags[i]) : 0);
+		}
+
+		auto it = m_setLayouts.find(signature);
+		if (it != m_setLayouts.end()) return *it->second;
+
+		// Update after bind bindings need the whole set created for an update after bind pool, which push descriptors don't come from
+		const bool updateAfterBind = std::ranges::any_of(bindingFlags, [](vk::DescriptorBindingFlags flags) { return bool(flags & vk::DescriptorBindingFlagBits::eUpdateAfterBind); });
+		if (updateAfterBind && pushDescriptor) throw std::runtime_error("push descriptor sets can't be updated after bind");
+
+		vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+		bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+		bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+		vk::DescriptorSetLayoutCreateInfo layoutInfo{};
+		if (!bindingFlags.empty()) layoutInfo.pNext = &bindingFlagsInfo;
+		if (updateAfterBind) layoutInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+		if (pushDescriptor) layoutInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		it = m_setLayouts.emplace(std::move(signature), vk::raii::DescriptorSetLayout{ *m_device, layoutInfo }).first;
+		m_setLayoutBindings.emplace(*it->second, std::vector<vk::DescriptorSetLayoutBinding>(bindings.begin(), bindings.end()));
+		return *it->second;
+	}
+
+	// Callers hold m_mutex
+	vk::PipelineLayout GetPipelineLayoutLocked(std::span<const vk::DescriptorSetLayout> setLayouts, std::span<const vk::PushConstantRange> pushConstantRanges)
+	{
+		Signature signature;
+		signature.push_back(static_cast<uint32_t>(setLayouts.size()));
+		for (vk::DescriptorSetLayout setLayout : setLayouts)
+		{
+			const uint64_t handle = reinterpret_cast<uint64_t>(static_cast<VkDescriptorSetLayout>(setLayout));
+			signature.push_back(static_cast<uint32_t>(handle));
+			signature.push_back(static_cast<uint32_t>(handle >> 32));
+		}
+		for (const vk::PushConstantRange& range : pushConstantRanges)
+		{
+			signature.push_back(static_cast<uint32_t>(range.stageFlags));
+			signature.push_back(range.offset);
+			signature.push_back(range.size);
+		}
+
+		auto it = m_pipelineLayouts.find(signature);
+		if (it != m_pipelineLayouts.end()) return *it->second;
+
+		vk::PipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		layoutInfo.pSetLayouts = setLayouts.data();
+		layoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+		layoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+		it = m_pipelineLayouts.emplace(std::move(signature), vk::raii::PipelineLayout{ *m_device, layoutInfo }).first;
+		return *it->second;
+	}
+
+public:
+	LayoutCache() = default;
+	LayoutCache(const LayoutCache&) = delete;
+	LayoutCache& operator=(const LayoutCache&) = delete;
+
+	// The device has to outlive the cache
+	void Init(const vk::raii::Device& device) { m_device = &device; }
+
+	// Destroys every layout, nothing built from them may still be in use
+	void Clear()
+	{
+		std::lock_guard lock(m_mutex);
+		m_pipelineLayouts.clear();
+		m_setLayoutBindings.clear();
+		m_setLayouts.clear();
+	}
+
+	// bindingFlags is empty or has one entry per binding
+	vk::DescriptorSetLayout GetSetLayout(std::span<const vk::DescriptorSetLayoutBinding> bindings, std::span<const vk::DescriptorBindingFlags> bindingFlags = {})
+	{
+		std::lock_guard lock(m_mutex);
+		return GetSetLayoutLocked(bindings, bindingFlags, false);
+	}
+
+	// What a set layout from this cache was created with, empty for layouts it doesn't know. Stays valid until Clear.
+	std::span<const vk::DescriptorSetLayoutBinding> GetSetLayoutBindings(vk::DescriptorSetLayout setLayout)
+	{
+		std::lock_guard lock(m_mutex);
+		const auto it = m_setLayoutBindings.find(setLayout);
+		return it == m_setLayoutBindings.end() ? std::span<const vk::DescriptorSetLayoutBinding>{} : it->second;
+	}
+
+	vk::PipelineLayout GetPipelineLayout(std::span<const vk::DescriptorSetLayout> setLayouts, std::span<const vk::PushConstantRange> pushConstantRanges)
+	{
+		std::lock_guard lock(m_mutex);
+		return GetPipelineLayoutLocked(setLayouts, pushConstantRanges);
+	}
+
+	// The layout a reflected module needs. Arrays are treated as bindless tables filled slot by slot while the set is in use,
+	// so they are partially bound and update after bind, and runtime sized ones get runtimeArrayCount descriptors.
+	// pushDescriptorSet, when given, is laid out for push descriptors, so it can't hold any such table.
+	ShaderLayout GetShaderLayout(const ShaderReflection& reflection, uint32_t runtimeArrayCount, uint32_t pushDescriptorSet = NO_PUSH_DESCRIPTOR_SET)
+	{
+		constexpr vk::DescriptorBindingFlags BINDLESS_FLAGS = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+
+		const uint32_t setCount = reflection.bindings.empty() ? 0 : reflection.bindings.back().set + 1;
+		std::vector<std::vector<vk::DescriptorSetLayoutBinding>> setBindings(setCount);
+		std::vector<std::vector<vk::DescriptorBindingFlags>> setBindingFlags(setCount);
+		for (const ReflectedBinding& reflected : reflection.bindings)
+		{
+			const bool bindless = reflected.count != 1;
+			setBindings[reflected.set].emplace_back(reflected.binding, reflected.type, reflected.count ? reflected.count : runtimeArrayCount, reflected.stages, nullptr);
+			setBindingFlags[reflected.set].push_back(bindless ? BINDLESS_FLAGS : vk::DescriptorBindingFlags{});
+		}
+
+		std::lock_guard lock(m_mutex);
+
+		ShaderLayout layout;
+		for (uint32_t set = 0; set < setCount; set++)
+		{
+			const bool anyFlags = std::ranges::any_of(setBindingFlags[set], [](vk::DescriptorBindingFlags flags) { return bool(flags); });
+			layout.setLayouts.push_back(GetSetLayoutLocked(setBindings[set], anyFlags ? std::span<const vk::DescriptorBindingFlags>(setBindingFlags[set]) : std::span<const vk::DescriptorBindingFlags>{}, set == pushDescriptorSet));
+		}
+		if (pushDescriptorSet < setCount) layout.pushDescriptorSet = pushDescriptorSet;
+		layout.pushConstantRanges = reflection.pushConstantRanges;
+		layout.pipelineLayout = GetPipelineLayoutLocked(layout.setLayouts, layout.pushConstantRanges);
+
+		return layout;
+	}
+
+	size_t GetSetLayoutCount()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_setLayouts.size();
+	}
+
+	size_t GetPipelineLayoutCount()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_pipelineLayouts.size();
+	}
+};
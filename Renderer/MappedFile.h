@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <stdexcept>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only memory mapping of a whole file. The OS pages data in on demand, so nothing is copied until it is touched.
+class MappedFile
+{
+	const std::byte* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+#else
+	int m_file = -1;
+#endif
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (m_data) UnmapViewOfFile(m_data);
+		if (m_mapping) CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if (m_data) munmap(const_cast<std::byte*>(m_data), m_size);
+		if (m_file >= 0) close(m_file);
+		m_file = -1;
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+public:
+	MappedFile() = default;
+
+	explicit MappedFile(const std::filesystem::path& path)
+	{
+#ifdef _WIN32
+		m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) throw std::runtime_error("failed to open file: " + path.string());
+
+		LARGE_INTEGER fileSize{};
+		GetFileSizeEx(m_file, &fileSize);
+		m_size = static_cast<size_t>(fileSize.QuadPart);
+		if (m_size == 0) return;
+
+		m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping) m_data = static_cast<const std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+		m_file = open(path.c_str(), O_RDONLY);
+		if (m_file < 0) throw std::runtime_error("failed to open file: " + path.string());
+
+		struct stat fileStat{};
+		fstat(m_file, &fileStat);
+		m_size = static_cast<size_t>(fileStat.st_size);
+		if (m_size == 0) return;
+
+		void* mapped = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+		if (mapped != MAP_FAILED)
+		{
+			m_data = static_cast<const std::byte*>(mapped);
+			madvise(mapped, m_size, MADV_SEQUENTIAL);
+		}
+#endif
+		if (!m_data)
+		{
+			Close();
+			throw std::runtime_error("failed to map file: " + path.string());
+		}
+	}
+
+	~MappedFile() { Close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this == &other) return *this;
+
+		Close();
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+		std::swap(m_file, other.m_file);
+#ifdef _WIN32
+		std::swap(m_mapping, other.m_mapping);
+#endif
+		return *this;
+	}
+
+	const std::byte* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+	std::span<const std::byte> Bytes() const { return { m_data, m_size }; }
+};
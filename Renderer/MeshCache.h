@@ -0,0 +1,152 @@
+#pragma once
+
+#include "MeshLod.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+// Cooked mesh file. The blobs are laid out exactly like the geometry pool wants them, so loading is a straight copy into staging.
+//   MeshCacheHeader | MeshCacheSubmesh[submeshCount] | vertex blob | index blob
+constexpr uint32_t MESH_CACHE_MAGIC = 0x4853454D; // "MESH"
+constexpr uint32_t MESH_CACHE_VERSION = 2;
+constexpr uint64_t MESH_CACHE_BLOB_ALIGNMENT = 16;
+
+struct MeshCacheHeader
+{
+	uint32_t magic = MESH_CACHE_MAGIC;
+	uint32_t version = MESH_CACHE_VERSION;
+	uint64_t sourceHash = 0;
+	uint32_t vertexStride = 0;
+	uint32_t indexSize = 0;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+	uint32_t submeshCount = 0;
+	float boundsRadius = 0.0f;
+	float boundsCenter[3] = {};
+	uint32_t partCount = 1; // Large meshes may be cooked as several files, <hash>.mesh, <hash>.1.mesh, ...
+	uint64_t vertexBlobOffset = 0;
+	uint64_t indexBlobOffset = 0;
+};
+
+// One LOD level inside the index blob
+struct MeshCacheSubmesh
+{
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	float error = 0.0f;
+	uint32_t reserved = 0;
+};
+
+struct MeshCacheView
+{
+	const MeshCacheHeader* header = nullptr;
+	std::span<const MeshCacheSubmesh> submeshes;
+	const std::byte* vertexData = nullptr;
+	const std::byte* indexData = nullptr;
+};
+
+// Validates a mapped cache file against what the renderer expects. Any mismatch means the cache is stale and must be re-cooked.
+inline bool ParseMeshCache(std::span<const std::byte> file, uint64_t sourceHash, uint32_t vertexStride, MeshCacheView& view)
+{
+	if (file.size() < sizeof(MeshCacheHeader)) return false;
+
+	const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(file.data());
+	if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION) return false;
+	if (header->sourceHash != sourceHash || header->vertexStride != vertexStride) return false;
+	if (header->indexSize != 1 && header->indexSize != 2 && header->indexSize != 4) return false;
+	if (header->partCount == 0) return false;
+	if (header->vertexCount == 0 || header->indexCount == 0) return false;
+
+	const uint64_t indexSize = header->indexSize;
+
+	// Offsets come from the file, so each one is bounded by its size before anything is added to it
+	const uint64_t fileSize = file.size();
+	const uint64_t submeshEnd = sizeof(MeshCacheHeader) + uint64_t(header->submeshCount) * sizeof(MeshCacheSubmesh);
+	if (header->submeshCount == 0 || submeshEnd > fileSize) return false;
+	if (header->vertexBlobOffset < submeshEnd || header->vertexBlobOffset > fileSize) return false;
+	if (uint64_t(header->vertexCount) * vertexStride > fileSize - header->vertexBlobOffset) return false;
+
+	const uint64_t vertexEnd = header->vertexBlobOffset + uint64_t(header->vertexCount) * vertexStride;
+	if (header->indexBlobOffset < vertexEnd || header->indexBlobOffset > fileSize) return false;
+	if (header->indexCount * indexSize > fileSize - header->indexBlobOffset) return false;
+
+	view.header = header;
+	view.submeshes = { reinterpret_cast<const MeshCacheSubmesh*>(file.data() + sizeof(MeshCacheHeader)), header->submeshCount };
+	view.vertexData = file.data() + header->vertexBlobOffset;
+	view.indexData = file.data() + header->indexBlobOffset;
+
+	for (const MeshCacheSubmesh& submesh : view.submeshes)
+	{
+		if (uint64_t(submesh.firstIndex) + submesh.indexCount > header->indexCount) return false;
+	}
+
+	return true;
+}
+
+// Checks every stored index against the vertex count. Kept out of ParseMeshCache as it reads the whole index blob, callers
+// run it before uploading. Blob offsets come from the file, so indices are read without assuming alignment.
+inline bool MeshCacheIndicesInRange(const MeshCacheView& view)
+{
+	const uint32_t indexSize = view.header->indexSize;
+	for (uint64_t i = 0; i < view.header->indexCount; i++)
+	{
+		uint32_t index = 0;
+		if (indexSize == 1) index = std::to_integer<uint32_t>(view.indexData[i]);
+		else if (indexSize == 2)
+		{
+			uint16_t value;
+			std::memcpy(&value, view.indexData + i * 2, 2);
+			index = value;
+		}
+		else std::memcpy(&index, view.indexData + i * 4, 4);
+
+		if (index >= view.header->vertexCount) return false;
+	}
+
+	return true;
+}
+
+// Writes next to the destination and renames over it, so a crash never leaves a torn cache behind
+inline void WriteMeshCache
+(
+	const std::filesystem::path& path,
+	MeshCacheHeader header,
+	std::span<const MeshLod> lods,
+	std::span<const std::byte> vertexBlob,
+	std::span<const std::byte> indexBlob
+)
+{
+	auto align = [](uint64_t offset) { return (offset + MESH_CACHE_BLOB_ALIGNMENT - 1) / MESH_CACHE_BLOB_ALIGNMENT * MESH_CACHE_BLOB_ALIGNMENT; };
+
+	std::vector<MeshCacheSubmesh> submeshes;
+	for (const MeshLod& lod : lods) submeshes.push_back({ lod.firstIndex, lod.indexCount, lod.error, 0 });
+
+	header.submeshCount = static_cast<uint32_t>(submeshes.size());
+	header.vertexBlobOffset = align(sizeof(MeshCacheHeader) + submeshes.size() * sizeof(MeshCacheSubmesh));
+	header.indexBlobOffset = align(header.vertexBlobOffset + vertexBlob.size());
+
+	std::vector<std::byte> file(header.indexBlobOffset + indexBlob.size());
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + sizeof(header), submeshes.data(), submeshes.size() * sizeof(MeshCacheSubmesh));
+	memcpy(file.data() + header.vertexBlobOffset, vertexBlob.data(), vertexBlob.size());
+	memcpy(file.data() + header.indexBlobOffset, indexBlob.data(), indexBlob.size());
+
+	std::filesystem::create_directories(path.parent_path());
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) return;
+		out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+		if (!out) return;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error) std::filesystem::remove(tempPath, error);
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <unordered_map>
+
+// One level of detail. Indices are relative to the owning mesh's index range and all levels share its vertices.
+struct MeshLod
+{
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	float error = 0.0f; // Object space distance the surface may deviate from LOD 0
+};
+
+struct LodLevel
+{
+	std::vector<uint32_t> indices;
+	float error = 0.0f;
+};
+
+// Quadric error metric simplifier based on half-edge collapses, so every level reuses the original vertex buffer.
+// Border edges and attribute seams are locked, and collapses are also charged for how far they drag the vertex attributes.
+class MeshSimplifier
+{
+	struct Quadric
+	{
+		double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+		double weight = 0;
+
+		static Quadric FromPlane(const glm::dvec3& n, double d, double w)
+		{
+			Quadric q;
+			q.a2 = n.x * n.x * w; q.ab = n.x * n.y * w; q.ac = n.x * n.z * w; q.ad = n.x * d * w;
+			q.b2 = n.y * n.y * w; q.bc = n.y * n.z * w; q.bd = n.y * d * w;
+			q.c2 = n.z * n.z * w; q.cd = n.z * d * w;
+			q.d2 = d * d * w;
+			q.weight = w;
+
+			return q;
+		}
+
+		Quadric& operator+=(const Quadric& o)
+		{
+			a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2; bc += o.bc; bd += o.bd; c2 += o.c2; cd += o.cd; d2 += o.d2;
+			weight += o.weight;
+
+			return *this;
+		}
+
+		// Area weighted mean squared distance of p to the accumulated planes
+		double Evaluate(const glm::dvec3& p) const
+		{
+			const double e =
+				a2 * p.x * p.x + 2.0 * ab * p.x * p.y + 2.0 * ac * p.x * p.z + 2.0 * ad * p.x +
+				b2 * p.y * p.y + 2.0 * bc * p.y * p.z + 2.0 * bd * p.y +
+				c2 * p.z * p.z + 2.0 * cd * p.z +
+				d2;
+
+			return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double cost;
+		double error;
+	};
+
+	static uint64_t EdgeKey(uint32_t a, uint32_t b) { return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a; }
+
+public:
+	// Simplifies towards targetIndexCount. error receives the largest geometric error introduced by this call.
+	static std::vector<uint32_t> Simplify
+	(
+		std::span<const glm::vec3> positions,
+		std::span<const float> attributes,
+		size_t attributeStride,
+		float attributeWeight,
+		const std::vector<uint32_t>& indices,
+		size_t targetIndexCount,
+		float& error
+	)
+	{
+		const size_t vertexCount = positions.size();
+		std::vector<uint32_t> result = indices;
+		error = 0.0f;
+
+		if (vertexCount == 0 || result.size() <= targetIndexCount) return result;
+
+		// Weld vertices that only differ by attributes so topology is judged on positions
+		std::vector<uint32_t> welded(vertexCount);
+		std::vector<uint32_t> weldCount(vertexCount, 0);
+		{
+			struct PositionHash { size_t operator()(const glm::vec3& p) const { return std::hash<float>{}(p.x) ^ (std::hash<float>{}(p.y) << 1) ^ (std::hash<float>{}(p.z) << 2); } };
+			std::unordered_map<glm::vec3, uint32_t, PositionHash> firstByPosition;
+			for (uint32_t v = 0; v < vertexCount; v++)
+			{
+				welded[v] = firstByPosition.try_emplace(positions[v], v).first->second;
+				weldCount[welded[v]]++;
+			}
+		}
+
+		// Lock seams and any vertex on a border or non-manifold edge
+		std::vector<uint8_t> locked(vertexCount, 0);
+		{
+			std::unordered_map<uint64_t, uint32_t> edgeUse;
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				for (int e = 0; e < 3; e++) edgeUse[EdgeKey(welded[result[i + e]], welded[result[i + (e + 1) % 3]])]++;
+			}
+			for (const auto& [key, count] : edgeUse)
+			{
+				if (count == 2) continue;
+				locked[key >> 32] = 1;
+				locked[key & 0xFFFFFFFF] = 1;
+			}
+			for (uint32_t v = 0; v < vertexCount; v++)
+			{
+				if (locked[welded[v]] || weldCount[welded[v]] > 1) locked[v] = 1;
+			}
+		}
+
+		glm::vec3 boundsMin = positions[0];
+		glm::vec3 boundsMax = positions[0];
+		for (const glm::vec3& p : positions) { boundsMin = glm::min(boundsMin, p); boundsMax = glm::max(boundsMax, p); }
+		const double extent = std::max(static_cast<double>(glm::length(boundsMax - boundsMin)), 1e-12);
+		const double invExtentSq = 1.0 / (extent * extent);
+
+		std::vector<Quadric> quadrics(vertexCount);
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			const glm::dvec3 p0 = positions[result[i + 0]];
+			const glm::dvec3 p1 = positions[result[i + 1]];
+			const glm::dvec3 p2 = positions[result[i + 2]];
+			const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+			const double area = glm::length(cross);
+			if (area <= 0.0) continue;
+
+			const glm::dvec3 normal = cross / area;
+			const Quadric q = Quadric::FromPlane(normal, -glm::dot(normal, p0), area);
+			for (int c = 0; c < 3; c++) quadrics[result[i + c]] += q;
+		}
+
+		auto attributeDistance = [&](uint32_t a, uint32_t b)
+		{
+			double d = 0.0;
+			for (size_t k = 0; k < attributeStride; k++)
+			{
+				const double delta = attributes[a * attributeStride + k] - attributes[b * attributeStride + k];
+				d += delta * delta;
+			}
+			return d;
+		};
+
+		std::vector<uint32_t> remap(vertexCount);
+		std::vector<uint8_t> touched(vertexCount);
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+		std::vector<uint32_t> adjacency;
+		std::vector<Collapse> collapses;
+
+		while (result.size() > targetIndexCount)
+		{
+			collapses.clear();
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				for (int e = 0; e < 3; e++)
+				{
+					const uint32_t a = result[i + e];
+					const uint32_t b = result[i + (e + 1) % 3];
+
+					for (auto [from, to] : { std::pair{ a, b }, std::pair{ b, a } })
+					{
+						if (locked[from]) continue;
+
+						Quadric q = quadrics[from];
+						q += quadrics[to];
+						const double geometric = q.Evaluate(positions[to]);
+						collapses.push_back({ from, to, geometric * invExtentSq + attributeWeight * attributeDistance(from, to), geometric });
+					}
+				}
+			}
+			if (collapses.empty()) break;
+
+			std::ranges::sort(collapses, {}, &Collapse::cost);
+
+			// Vertex to triangle adjacency for the flip test
+			std::ranges::fill(adjacencyOffsets, 0);
+			for (uint32_t index : result) adjacencyOffsets[index + 1]++;
+			for (size_t v = 0; v < vertexCount; v++) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+			adjacency.resize(result.size());
+			{
+				std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < result.size(); i++) adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+
+			for (uint32_t v = 0; v < vertexCount; v++) remap[v] = v;
+			std::ranges::fill(touched, 0);
+
+			const size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+			size_t trianglesRemoved = 0;
+
+			for (const Collapse& collapse : collapses)
+			{
+				if (trianglesRemoved >= trianglesToRemove) break;
+				if (touched[collapse.from] || touched[collapse.to]) continue;
+
+				bool flips = false;
+				size_t sharedTriangles = 0;
+				for (uint32_t t = adjacencyOffsets[collapse.from]; t < adjacencyOffsets[collapse.from + 1] && !flips; t++)
+				{
+					const uint32_t* tri = &result[size_t(adjacency[t]) * 3];
+					if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) { sharedTriangles++; continue; }
+
+					glm::vec3 before[3];
+					glm::vec3 after[3];
+					for (int c = 0; c < 3; c++)
+					{
+						before[c] = positions[tri[c]];
+						after[c] = tri[c] == collapse.from ? positions[collapse.to] : before[c];
+					}
+					const glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+					const glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+					flips = glm::dot(n0, n1) <= 0.0f;
+				}
+				if (flips) continue;
+
+				remap[collapse.from] = collapse.to;
+				quadrics[collapse.to] += quadrics[collapse.from];
+
+				// The whole one-ring, not just the edge. A later collapse next to from would otherwise run its flip test
+				// against from's old position.
+				for (uint32_t t = adjacencyOffsets[collapse.from]; t < adjacencyOffsets[collapse.from + 1]; t++)
+				{
+					const uint32_t* tri = &result[size_t(adjacency[t]) * 3];
+					for (int c = 0; c < 3; c++) touched[tri[c]] = 1;
+				}
+				touched[collapse.to] = 1;
+				trianglesRemoved += sharedTriangles;
+				error = std::max(error, static_cast<float>(std::sqrt(collapse.error)));
+			}
+			if (trianglesRemoved == 0) break;
+
+			size_t write = 0;
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				const uint32_t a = remap[result[i + 0]];
+				const uint32_t b = remap[result[i + 1]];
+				const uint32_t c = remap[result[i + 2]];
+				if (a == b || b == c || c == a) continue;
+
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+			result.resize(write);
+		}
+
+		return result;
+	}
+
+	// Builds up to maxLevels levels, halving the triangle count each time. Stops early once a level no longer shrinks meaningfully.
+	static std::vector<LodLevel> BuildLodChain
+	(
+		std::span<const glm::vec3> positions,
+		std::span<const float> attributes,
+		size_t attributeStride,
+		float attributeWeight,
+		const std::vector<uint32_t>& indices,
+		size_t maxLevels = 5
+	)
+	{
+		std::vector<LodLevel> chain;
+		chain.push_back({ indices, 0.0f });
+
+		while (chain.size() < maxLevels)
+		{
+			const LodLevel& previous = chain.back();
+			const size_t target = previous.indices.size() / 6 * 3;
+			if (target < 3) break;
+
+			float levelError = 0.0f;
+			std::vector<uint32_t> simplified = Simplify(positions, attributes, attributeStride, attributeWeight, previous.indices, target, levelError);
+			if (simplified.empty() || simplified.size() * 10 > previous.indices.size() * 9) break;
+
+			// Errors accumulate along the chain so they stay monotonic for selection
+			chain.push_back({ std::move(simplified), previous.error + levelError });
+		}
+
+		return chain;
+	}
+};
+
+// Picks the coarsest level whose projected error stays under thresholdPixels.
+// Going coarser needs the error to drop hysteresis below the threshold, so objects near a boundary don't flicker between levels.
+inline uint32_t SelectLod(const std::vector<MeshLod>& lods, uint32_t currentLod, float distance, float pixelsPerUnit, float thresholdPixels, float hysteresis)
+{
+	const float invDistance = 1.0f / std::max(distance, 1e-4f);
+
+	uint32_t lod = 0;
+	for (uint32_t i = 1; i < lods.size(); i++)
+	{
+		const float projectedError = lods[i].error * pixelsPerUnit * invDistance;
+		const float limit = i > currentLod ? thresholdPixels * (1.0f - hysteresis) : thresholdPixels;
+		if (projectedError > limit) break;
+
+		lod = i;
+	}
+
+	return lod;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <cstddef>
+#include <atomic>
+#include <algorithm>
+
+// Runs body(begin, end) over [0, count) in batches of at least minBatch, spread over the job system's threads.
+// The calling thread takes batches too and the call returns once every batch is done.
+template<typename Body>
+void ParallelFor(size_t count, size_t minBatch, Body&& body)
+{
+	if (count == 0) return;
+
+	JobSystem& jobSystem = JobSystem::Get();
+	const size_t threadCount = jobSystem.GetThreadCount();
+	const size_t batchSize = std::max(minBatch, (count + threadCount * 4 - 1) / (threadCount * 4));
+	const size_t batchCount = (count + batchSize - 1) / batchSize;
+	if (batchCount == 1)
+	{
+		body(size_t{ 0 }, count);
+		return;
+	}
+
+	std::atomic<size_t> nextBatch{ 0 };
+	auto worker = [&]()
+	{
+		for (size_t batch = nextBatch++; batch < batchCount; batch = nextBatch++)
+		{
+			body(batch * batchSize, std::min(count, (batch + 1) * batchSize));
+		}
+	};
+
+	JobCounter done;
+	for (size_t i = 1; i < std::min(threadCount, batchCount); i++) jobSystem.Schedule(worker, &done);
+	worker();
+	jobSystem.Wait(done);
+}
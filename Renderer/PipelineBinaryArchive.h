@@ -0,0 +1,247 @@
+#pragma once
+
+#include "Hash.h"
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <span>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+
+// Pipeline binary archive: the driver's compiled pipeline binaries (VK_KHR_pipeline_binary) by pipeline key.
+//   PipelineBinaryArchiveHeader | records
+//   record: PipelineBinaryKey pipelineKey | uint32 binaryCount | binaryCount * (PipelineBinaryRecord | data padded to 8 bytes)
+// The header carries the device and driver UUIDs and the driver's global pipeline key, any change to those throws the whole archive away.
+constexpr uint32_t PIPELINE_BINARY_ARCHIVE_MAGIC = 0x4E494250; // "PBIN"
+constexpr uint32_t PIPELINE_BINARY_ARCHIVE_VERSION = 1;
+constexpr size_t PIPELINE_BINARY_KEY_SIZE = 32; // VK_MAX_PIPELINE_BINARY_KEY_SIZE_KHR
+
+struct PipelineBinaryKey
+{
+	uint32_t size = 0;
+	std::array<uint8_t, PIPELINE_BINARY_KEY_SIZE> bytes{};
+
+	bool operator==(const PipelineBinaryKey& other) const { return size == other.size && memcmp(bytes.data(), other.bytes.data(), size) == 0; }
+};
+
+struct PipelineBinaryKeyHash
+{
+	size_t operator()(const PipelineBinaryKey& key) const { return static_cast<size_t>(HashBytes(key.bytes.data(), key.size)); }
+};
+
+struct PipelineBinaryArchiveHeader
+{
+	uint32_t magic = PIPELINE_BINARY_ARCHIVE_MAGIC;
+	uint32_t version = PIPELINE_BINARY_ARCHIVE_VERSION;
+	uint8_t deviceUUID[16] = {};
+	uint8_t driverUUID[16] = {};
+	PipelineBinaryKey globalKey;
+	uint32_t pipelineCount = 0;
+	uint64_t dataSize = 0;
+	uint64_t dataHash = 0;
+};
+
+struct PipelineBinaryRecord
+{
+	PipelineBinaryKey key;
+	uint32_t reserved = 0;
+	uint64_t dataSize = 0;
+};
+
+struct PipelineBinary
+{
+	PipelineBinaryKey key;
+	std::vector<std::byte> data;
+};
+
+// Loaded once at startup, filled in from the compile threads, saved on exit and every so often.
+// Records are only ever added, so what Find returns stays valid for the archive's lifetime.
+class PipelineBinaryArchive
+{
+	static constexpr uint64_t DATA_ALIGNMENT = 8;
+
+	mutable std::mutex m_mutex;
+	PipelineBinaryArchiveHeader m_identity;
+	std::unordered_map<PipelineBinaryKey, std::vector<PipelineBinary>, PipelineBinaryKeyHash> m_pipelines;
+	bool m_dirty = false;
+
+	static uint64_t Align(uint64_t offset) { return (offset + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT; }
+
+	// Reads the records after the header, false on anything out of bounds
+	bool ParseRecords(std::span<const std::byte> data, uint32_t pipelineCount)
+	{
+		uint64_t offset = 0;
+		auto read = [&](void* destination, uint64_t size)
+		{
+			if (offset + size > data.size()) return false;
+			memcpy(destination, data.data() + offset, size);
+			offset += size;
+			return true;
+		};
+
+		for (uint32_t pipeline = 0; pipeline < pipelineCount; pipeline++)
+		{
+			PipelineBinaryKey pipelineKey;
+			uint32_t binaryCount = 0;
+			if (!read(&pipelineKey, sizeof(pipelineKey)) || !read(&binaryCount, sizeof(binaryCount))) return false;
+			if (pipelineKey.size > PIPELINE_BINARY_KEY_SIZE || binaryCount == 0) return false;
+
+			std::vector<PipelineBinary> binaries(binaryCount);
+			for (PipelineBinary& binary : binaries)
+			{
+				offset = Align(offset);
+
+				PipelineBinaryRecord record;
+				if (!read(&record, sizeof(record)) || record.key.size > PIPELINE_BINARY_KEY_SIZE || record.dataSize == 0) return false;
+
+				binary.key = record.key;
+				binary.data.resize(record.dataSize);
+				if (!read(binary.data.data(), record.dataSize)) return false;
+			}
+
+			m_pipelines.try_emplace(pipelineKey, std::move(binaries));
+		}
+
+		return offset <= data.size();
+	}
+
+	static bool WriteArchive(const std::filesystem::path& path, const PipelineBinaryArchiveHeader& header, std::span<const std::byte> data)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+		std::filesystem::path tempPath = path;
+		tempPath += ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) return false;
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+			out.close();
+			if (!out)
+			{
+				std::filesystem::remove(tempPath, error);
+				return false;
+			}
+		}
+
+		std::filesystem::rename(tempPath, path, error);
+		if (error)
+		{
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+
+		return true;
+	}
+
+public:
+	// identity carries the running device's UUIDs and global key. Returns false and starts empty when the file is missing, stale or damaged.
+	bool Load(const std::filesystem::path& path, const PipelineBinaryArchiveHeader& identity)
+	{
+		std::lock_guard lock(m_mutex);
+		m_identity = identity;
+		m_pipelines.clear();
+		m_dirty = false;
+		if (!std::filesystem::exists(path)) return false;
+
+		const MappedFile file(path);
+		const std::span<const std::byte> bytes = file.Bytes();
+		if (bytes.size() < sizeof(PipelineBinaryArchiveHeader)) return false;
+
+		PipelineBinaryArchiveHeader header;
+		memcpy(&header, bytes.data(), sizeof(header));
+		if (header.magic != PIPELINE_BINARY_ARCHIVE_MAGIC || header.version != PIPELINE_BINARY_ARCHIVE_VERSION) return false;
+		if (memcmp(header.deviceUUID, identity.deviceUUID, sizeof(header.deviceUUID)) != 0) return false;
+		if (memcmp(header.driverUUID, identity.driverUUID, sizeof(header.driverUUID)) != 0) return false;
+		if (!(header.globalKey == identity.globalKey)) return false;
+		if (header.dataSize != bytes.size() - sizeof(PipelineBinaryArchiveHeader)) return false;
+
+		const std::span<const std::byte> data = bytes.subspan(sizeof(PipelineBinaryArchiveHeader));
+		if (HashBytes(data) != header.dataHash || !ParseRecords(data, header.pipelineCount))
+		{
+			m_pipelines.clear();
+			return false;
+		}
+
+		return true;
+	}
+
+	// Binaries stored for a pipeline key, or null
+	const std::vector<PipelineBinary>* Find(const PipelineBinaryKey& pipelineKey) const
+	{
+		std::lock_guard lock(m_mutex);
+		const auto it = m_pipelines.find(pipelineKey);
+		return it == m_pipelines.end() ? nullptr : &it->second;
+	}
+
+	// Keeps the first binaries added for a key
+	void Add(const PipelineBinaryKey& pipelineKey, std::vector<PipelineBinary> binaries)
+	{
+		if (binaries.empty()) return;
+
+		std::lock_guard lock(m_mutex);
+		if (m_pipelines.try_emplace(pipelineKey, std::move(binaries)).second) m_dirty = true;
+	}
+
+	size_t Size() const
+	{
+		std::lock_guard lock(m_mutex);
+		return m_pipelines.size();
+	}
+
+	// Writes next to the destination and renames over it, so a crash never leaves a torn archive behind.
+	// Does nothing when no binaries were added since the last save. Returns false if writing failed, the next save tries again.
+	bool Save(const std::filesystem::path& path)
+	{
+		std::vector<std::byte> data;
+		PipelineBinaryArchiveHeader header;
+		{
+			std::lock_guard lock(m_mutex);
+			if (!m_dirty) return true;
+
+			auto write = [&data](const void* source, uint64_t size)
+			{
+				const size_t offset = data.size();
+				data.resize(offset + size);
+				memcpy(data.data() + offset, source, size);
+			};
+
+			for (const auto& [pipelineKey, binaries] : m_pipelines)
+			{
+				const uint32_t binaryCount = static_cast<uint32_t>(binaries.size());
+				write(&pipelineKey, sizeof(pipelineKey));
+				write(&binaryCount, sizeof(binaryCount));
+				for (const PipelineBinary& binary : binaries)
+				{
+					data.resize(Align(data.size()));
+
+					PipelineBinaryRecord record;
+					record.key = binary.key;
+					record.dataSize = binary.data.size();
+					write(&record, sizeof(record));
+					write(binary.data.data(), binary.data.size());
+				}
+			}
+
+			header = m_identity;
+			header.magic = PIPELINE_BINARY_ARCHIVE_MAGIC;
+			header.version = PIPELINE_BINARY_ARCHIVE_VERSION;
+			header.pipelineCount = static_cast<uint32_t>(m_pipelines.size());
+			m_dirty = false;
+		}
+		header.dataSize = data.size();
+		header.dataHash = HashBytes(data);
+
+		if (WriteArchive(path, header, data)) return true;
+
+		std::lock_guard lock(m_mutex);
+		m_dirty = true;
+		return false;
+	}
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Hash.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+// Pipeline cache file: PipelineCacheHeader | driver blob.
+// Drivers don't have to cope with a blob from another device, another driver version or a torn write, so the blob is only
+// handed back when all of that matches and its checksum is intact. Anything else starts from an empty cache.
+constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x45504950; // "PIPE"
+constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+struct PipelineCacheHeader
+{
+	uint32_t magic = PIPELINE_CACHE_MAGIC;
+	uint32_t version = PIPELINE_CACHE_VERSION;
+	uint32_t vendorID = 0;
+	uint32_t deviceID = 0;
+	uint32_t driverVersion = 0;
+	uint8_t pipelineCacheUUID[16] = {};
+	uint32_t reserved = 0;
+	uint64_t dataSize = 0;
+	uint64_t dataHash = 0;
+};
+
+// The header every driver blob starts with, VkPipelineCacheHeaderVersionOne
+struct DriverPipelineCacheHeader
+{
+	uint32_t headerSize;
+	uint32_t headerVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint8_t pipelineCacheUUID[16];
+};
+
+// expected carries the identity of the running device, the size and hash fields are ignored.
+// Returns the driver blob, or nothing when the file is stale or damaged.
+inline std::span<const std::byte> ParsePipelineCache(std::span<const std::byte> file, const PipelineCacheHeader& expected)
+{
+	if (file.size() < sizeof(PipelineCacheHeader)) return {};
+
+	PipelineCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION) return {};
+	if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID || header.driverVersion != expected.driverVersion) return {};
+	if (memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, sizeof(header.pipelineCacheUUID)) != 0) return {};
+	if (header.dataSize != file.size() - sizeof(PipelineCacheHeader)) return {};
+
+	const std::span<const std::byte> data = file.subspan(sizeof(PipelineCacheHeader));
+	if (HashBytes(data) != header.dataHash) return {};
+
+	// The driver's own header has to agree with ours
+	if (data.size() < sizeof(DriverPipelineCacheHeader)) return {};
+
+	DriverPipelineCacheHeader driverHeader;
+	memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+	if (driverHeader.headerVersion != 1 || driverHeader.headerSize < sizeof(DriverPipelineCacheHeader) || driverHeader.headerSize > data.size()) return {};
+	if (driverHeader.vendorID != expected.vendorID || driverHeader.deviceID != expected.deviceID) return {};
+	if (memcmp(driverHeader.pipelineCacheUUID, expected.pipelineCacheUUID, sizeof(driverHeader.pipelineCacheUUID)) != 0) return {};
+
+	return data;
+}
+
+// Writes next to the destination and renames over it, so a crash never leaves a torn cache behind. Returns false if nothing was written.
+inline bool WritePipelineCache(const std::filesystem::path& path, PipelineCacheHeader header, std::span<const std::byte> data)
+{
+	header.magic = PIPELINE_CACHE_MAGIC;
+	header.version = PIPELINE_CACHE_VERSION;
+	header.dataSize = data.size();
+	header.dataHash = HashBytes(data);
+
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) return false;
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		out.close();
+		if (!out)
+		{
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	return true;
+}
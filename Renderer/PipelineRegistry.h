@@ -0,0 +1,900 @@
+#pragma once
+
+#include "Hash.h"
+#include "PipelineBinaryArchive.h"
+#include "ShaderLibrary.h"
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+enum class BlendMode : uint32_t
+{
+	Opaque,
+	Alpha,
+	Additive
+};
+
+struct PipelineVertexAttribute
+{
+	vk::Format format = vk::Format::eUndefined; // eUndefined ends the list
+	uint32_t offset = 0;
+};
+
+// Everything that tells two graphics pipelines apart, as plain bytes so it can be hashed and compared directly.
+// Every byte takes part, so there is no implicit padding and entry points are zero filled.
+// shader is a ShaderLibrary id, the module both entry points come from.
+// Vertex attribute i goes to location i of binding 0, vertexStride 0 means no vertex input at all (vertex pulling).
+// Specialization constant i of both stages takes specialization[i], booleans as 0 or 1. Ids a stage doesn't declare are ignored.
+struct GraphicsPipelineDesc
+{
+	static constexpr size_t MAX_ENTRY_POINT = 32;
+	static constexpr size_t MAX_VERTEX_ATTRIBUTES = 4;
+	static constexpr size_t MAX_SPECIALIZATION_CONSTANTS = 4;
+
+	uint64_t shader = 0;
+	vk::PipelineLayout layout;
+	std::array<char, MAX_ENTRY_POINT> vertexEntryPoint{};
+	std::array<char, MAX_ENTRY_POINT> fragmentEntryPoint{};
+
+	uint32_t vertexStride = 0;
+	std::array<PipelineVertexAttribute, MAX_VERTEX_ATTRIBUTES> vertexAttributes{};
+
+	vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+	vk::PolygonMode polygonMode = vk::PolygonMode::eFill;
+	vk::CullModeFlagBits cullMode = vk::CullModeFlagBits::eBack;
+	vk::FrontFace frontFace = vk::FrontFace::eCounterClockwise;
+
+	uint32_t depthTest = 1;
+	uint32_t depthWrite = 1;
+	vk::CompareOp depthCompare = vk::CompareOp::eLess;
+	BlendMode blend = BlendMode::Opaque;
+
+	vk::Format colorFormat = vk::Format::eUndefined;
+	vk::Format depthFormat = vk::Format::eUndefined;
+	std::array<uint32_t, MAX_SPECIALIZATION_CONSTANTS> specialization{};
+	uint32_t padding = 0;
+
+	void SetEntryPoints(const char* vertex, const char* fragment)
+	{
+		vertexEntryPoint.fill('\0');
+		fragmentEntryPoint.fill('\0');
+		strncpy(vertexEntryPoint.data(), vertex, MAX_ENTRY_POINT - 1);
+		strncpy(fragmentEntryPoint.data(), fragment, MAX_ENTRY_POINT - 1);
+	}
+
+	bool operator==(const GraphicsPipelineDesc& other) const { return memcmp(this, &other, sizeof(GraphicsPipelineDesc)) == 0; }
+};
+static_assert(sizeof(GraphicsPipelineDesc) == 176, "GraphicsPipelineDesc must not have implicit padding");
+
+struct GraphicsPipelineDescHash
+{
+	size_t operator()(const GraphicsPipelineDesc& desc) const { return static_cast<size_t>(HashValue(desc)); }
+};
+
+// How the registry turns a description into something bindable.
+// Monolithic: one full pipeline per description.
+// Library: VK_EXT_graphics_pipeline_library. The vertex input, pre-rasterization, fragment shader and fragment output parts
+// are compiled once each and shared, so a description whose parts already exist is fast linked right inside Request.
+// An optimized link follows in the background and replaces the fast one once done.
+// ShaderObject: VK_EXT_shader_object. No pipelines at all, linked vertex and fragment shader objects plus dynamic state.
+enum class PipelineBackend : uint32_t
+{
+	Monolithic,
+	Library,
+	ShaderObject
+};
+
+// What Request hands out, bound with PipelineRegistry::Bind. Empty while nothing usable exists yet.
+struct GraphicsPipelineHandle
+{
+	const GraphicsPipelineDesc* desc = nullptr;
+	vk::Pipeline pipeline;
+	vk::ShaderEXT vertexShader;
+	vk::ShaderEXT fragmentShader;
+
+	explicit operator bool() const { return desc != nullptr; }
+};
+
+// Graphics pipelines by description, compiled on demand by the registry's own background threads.
+// Request never blocks: until a pipeline is built it returns an empty handle and the caller skips the draw or falls back.
+// Compiles get their own threads rather than job system jobs, as JobSystem::Wait runs whatever job it finds and a
+// frame waiting on its update would end up compiling shaders.
+// Viewport and scissor are dynamic with count for every backend, the caller sets them with setViewportWithCount and setScissorWithCount.
+class PipelineRegistry
+{
+	enum class State : uint32_t
+	{
+		Compiling,
+		Ready,
+		Failed
+	};
+
+	struct Entry
+	{
+		GraphicsPipelineDesc desc;
+		std::atomic<State> state{ State::Compiling };
+		vk::raii::Pipeline pipeline = nullptr;
+
+		// Library backend: the fast linked pipeline stays alive after the optimized one lands, frames in flight may still use it
+		std::atomic<bool> optimized{ false };
+		vk::raii::Pipeline optimizedPipeline = nullptr;
+
+		// Shader object backend
+		vk::raii::ShaderEXT vertexShader = nullptr;
+		vk::raii::ShaderEXT fragmentShader = nullptr;
+	};
+
+	// One part of a library pipeline, shared by every description with the same fields for that part
+	struct Library
+	{
+		std::once_flag built;
+		std::atomic<bool> ready{ false };
+		vk::raii::Pipeline pipeline = nullptr;
+	};
+
+	enum LibraryPart : uint32_t
+	{
+		LIBRARY_VERTEX_INPUT,
+		LIBRARY_PRE_RASTERIZATION,
+		LIBRARY_FRAGMENT_SHADER,
+		LIBRARY_FRAGMENT_OUTPUT,
+		LIBRARY_PART_COUNT
+	};
+
+	// Shader objects take SPIR-V and set layouts directly rather than modules and pipeline layouts
+	struct LayoutInterface
+	{
+		std::vector<vk::DescriptorSetLayout> setLayouts;
+		std::vector<vk::PushConstantRange> pushConstantRanges;
+	};
+
+	// A description's specialization constants, shared by both stages
+	struct SpecializationState
+	{
+		std::array<vk::SpecializationMapEntry, GraphicsPipelineDesc::MAX_SPECIALIZATION_CONSTANTS> entries;
+		vk::SpecializationInfo info;
+
+		explicit SpecializationState(const GraphicsPipelineDesc& desc)
+		{
+			for (uint32_t id = 0; id < entries.size(); id++) entries[id] = vk::SpecializationMapEntry{ id, id * static_cast<uint32_t>(sizeof(uint32_t)), sizeof(uint32_t) };
+
+			info.mapEntryCount = static_cast<uint32_t>(entries.size());
+			info.pMapEntries = entries.data();
+			info.dataSize = sizeof(desc.specialization);
+			info.pData = desc.specialization.data();
+		}
+
+		SpecializationState(const SpecializationState&) = delete;
+		SpecializationState& operator=(const SpecializationState&) = delete;
+	};
+
+	// Every create info struct of a full pipeline filled in from a description. Points into itself, so it stays put.
+	// With inlineShaderCode the stages carry the library's code themselves (VK_KHR_maintenance5) and no module is created.
+	struct PipelineState
+	{
+		SpecializationState specialization;
+		vk::ShaderModuleCreateInfo shaderCode{};
+		std::array<vk::PipelineShaderStageCreateInfo, 2> shaderStages{};
+		vk::VertexInputBindingDescription binding;
+		std::vector<vk::VertexInputAttributeDescription> attributes;
+		vk::PipelineVertexInputStateCreateInfo vertexInput{};
+		vk::PipelineInputAssemblyStateCreateInfo inputAssembly{};
+		vk::PipelineViewportStateCreateInfo viewport{};
+		vk::PipelineRasterizationStateCreateInfo rasterizer{};
+		vk::PipelineMultisampleStateCreateInfo multisampling{};
+		vk::PipelineDepthStencilStateCreateInfo depthStencil{};
+		vk::PipelineColorBlendAttachmentState colorBlendAttachment{};
+		vk::PipelineColorBlendStateCreateInfo colorBlending{};
+		std::array<vk::DynamicState, 2> dynamicStates = { vk::DynamicState::eViewportWithCount, vk::DynamicState::eScissorWithCount };
+		vk::PipelineDynamicStateCreateInfo dynamicState{};
+		vk::PipelineRenderingCreateInfo rendering{};
+
+		PipelineState(const GraphicsPipelineDesc& desc, ShaderLibrary& shaderLibrary, bool inlineShaderCode) : specialization(desc)
+		{
+			const std::span<const uint32_t> code = shaderLibrary.GetCode(desc.shader);
+			if (code.empty()) throw std::runtime_error("unknown shader in pipeline description");
+
+			shaderCode.codeSize = code.size_bytes();
+			shaderCode.pCode = code.data();
+			const vk::ShaderModule shaderModule = inlineShaderCode ? nullptr : shaderLibrary.GetShaderModule(desc.shader);
+
+			shaderStages[0].stage = vk::ShaderStageFlagBits::eVertex;
+			shaderStages[0].module = shaderModule;
+			shaderStages[0].pName = desc.vertexEntryPoint.data();
+			shaderStages[0].pSpecializationInfo = &specialization.info;
+			shaderStages[1].stage = vk::ShaderStageFlagBits::eFragment;
+			shaderStages[1].module = shaderModule;
+			shaderStages[1].pName = desc.fragmentEntryPoint.data();
+			shaderStages[1].pSpecializationInfo = &specialization.info;
+			if (inlineShaderCode)
+			{
+				shaderStages[0].pNext = &shaderCode;
+				shaderStages[1].pNext = &shaderCode;
+			}
+
+			binding = vk::VertexInputBindingDescription{ 0, desc.vertexStride, vk::VertexInputRate::eVertex };
+			for (uint32_t location = 0; location < desc.vertexAttributes.size(); location++)
+			{
+				const PipelineVertexAttribute& attribute = desc.vertexAttributes[location];
+				if (attribute.format == vk::Format::eUndefined) break;
+				attributes.emplace_back(location, 0, attribute.format, attribute.offset);
+			}
+
+			if (desc.vertexStride)
+			{
+				vertexInput.vertexBindingDescriptionCount = 1;
+				vertexInput.pVertexBindingDescriptions = &binding;
+				vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+				vertexInput.pVertexAttributeDescriptions = attributes.data();
+			}
+
+			inputAssembly.topology = desc.topology;
+
+			rasterizer.polygonMode = desc.polygonMode;
+			rasterizer.cullMode = desc.cullMode;
+			rasterizer.frontFace = desc.frontFace;
+			rasterizer.depthBiasSlopeFactor = 1.0f;
+			rasterizer.lineWidth = 1.0f;
+
+			multisampling.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+			depthStencil.depthTestEnable = desc.depthTest != 0;
+			depthStencil.depthWriteEnable = desc.depthWrite != 0;
+			depthStencil.depthCompareOp = desc.depthCompare;
+
+			colorBlendAttachment = BlendAttachment(desc.blend);
+			colorBlending.attachmentCount = 1;
+			colorBlending.pAttachments = &colorBlendAttachment;
+
+			dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+			dynamicState.pDynamicStates = dynamicStates.data();
+
+			rendering.colorAttachmentCount = 1;
+			rendering.pColorAttachmentFormats = &desc.colorFormat;
+			rendering.depthAttachmentFormat = desc.depthFormat;
+		}
+
+		PipelineState(const PipelineState&) = delete;
+		PipelineState& operator=(const PipelineState&) = delete;
+	};
+
+	const vk::raii::Device* m_device = nullptr;
+	const vk::raii::PipelineCache* m_pipelineCache = nullptr;
+	PipelineBackend m_backend = PipelineBackend::Monolithic;
+	PipelineBinaryArchive* m_binaryArchive = nullptr;
+	ShaderLibrary* m_shaderLibrary = nullptr;
+	bool m_inlineShaderCode = false;
+
+	std::mutex m_mutex;
+	std::condition_variable m_queueChanged;
+	std::condition_variable m_idle;
+	std::unordered_map<GraphicsPipelineDesc, std::unique_ptr<Entry>, GraphicsPipelineDescHash> m_entries;
+	std::array<std::unordered_map<uint64_t, std::unique_ptr<Library>>, LIBRARY_PART_COUNT> m_libraries;
+	std::unordered_map<vk::PipelineLayout, LayoutInterface> m_layoutInterfaces;
+	std::deque<std::function<void()>> m_queue;
+	uint32_t m_compiling = 0;
+	bool m_stopping = false;
+	std::vector<std::jthread> m_threads;
+
+	std::atomic<uint64_t> m_compileMicroseconds{ 0 };
+	std::atomic<uint64_t> m_fastLinks{ 0 };
+	std::atomic<uint64_t> m_binaryLoads{ 0 };
+
+	static vk::PipelineColorBlendAttachmentState BlendAttachment(BlendMode blend)
+	{
+		vk::PipelineColorBlendAttachmentState attachment{};
+		attachment.colorWriteMask =
+			vk::ColorComponentFlagBits::eR |
+			vk::ColorComponentFlagBits::eG |
+			vk::ColorComponentFlagBits::eB |
+			vk::ColorComponentFlagBits::eA;
+		if (blend == BlendMode::Opaque) return attachment;
+
+		attachment.blendEnable = vk::True;
+		attachment.srcColorBlendFactor = blend == BlendMode::Alpha ? vk::BlendFactor::eSrcAlpha : vk::BlendFactor::eOne;
+		attachment.dstColorBlendFactor = blend == BlendMode::Alpha ? vk::BlendFactor::eOneMinusSrcAlpha : vk::BlendFactor::eOne;
+		attachment.colorBlendOp = vk::BlendOp::eAdd;
+		attachment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+		attachment.dstAlphaBlendFactor = blend == BlendMode::Alpha ? vk::BlendFactor::eOneMinusSrcAlpha : vk::BlendFactor::eOne;
+		attachment.alphaBlendOp = vk::BlendOp::eAdd;
+
+		return attachment;
+	}
+
+	// Hash of the description fields a library part depends on. The shader parts also take the attachment formats,
+	// since every part of a linked pipeline has to agree on its rendering info.
+	static uint64_t LibraryKey(const GraphicsPipelineDesc& desc, LibraryPart part)
+	{
+		uint64_t hash = HashValue(part);
+		const uint64_t formats = HashCombine(HashValue(desc.colorFormat), static_cast<uint64_t>(desc.depthFormat));
+		switch (part)
+		{
+		case LIBRARY_VERTEX_INPUT:
+			hash = HashValue(desc.vertexStride, hash);
+			hash = HashValue(desc.vertexAttributes, hash);
+			return HashValue(desc.topology, hash);
+		case LIBRARY_PRE_RASTERIZATION:
+			hash = HashValue(desc.shader, hash);
+			hash = HashValue(desc.layout, hash);
+			hash = HashValue(desc.vertexEntryPoint, hash);
+			hash = HashValue(desc.specialization, hash);
+			hash = HashValue(desc.polygonMode, hash);
+			hash = HashValue(desc.cullMode, hash);
+			hash = HashValue(desc.frontFace, hash);
+			return HashCombine(hash, formats);
+		case LIBRARY_FRAGMENT_SHADER:
+			hash = HashValue(desc.shader, hash);
+			hash = HashValue(desc.layout, hash);
+			hash = HashValue(desc.fragmentEntryPoint, hash);
+			hash = HashValue(desc.specialization, hash);
+			hash = HashValue(desc.depthTest, hash);
+			hash = HashValue(desc.depthWrite, hash);
+			hash = HashValue(desc.depthCompare, hash);
+			return HashCombine(hash, formats);
+		default:
+			return HashCombine(HashValue(desc.blend, hash), formats);
+		}
+	}
+
+	static vk::GraphicsPipelineCreateInfo FullPipelineInfo(const PipelineState& state, const GraphicsPipelineDesc& desc)
+	{
+		vk::GraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.pNext = &state.rendering;
+		pipelineInfo.stageCount = static_cast<uint32_t>(state.shaderStages.size());
+		pipelineInfo.pStages = state.shaderStages.data();
+		pipelineInfo.pVertexInputState = &state.vertexInput;
+		pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+		pipelineInfo.pViewportState = &state.viewport;
+		pipelineInfo.pRasterizationState = &state.rasterizer;
+		pipelineInfo.pMultisampleState = &state.multisampling;
+		pipelineInfo.pDepthStencilState = &state.depthStencil;
+		pipelineInfo.pColorBlendState = &state.colorBlending;
+		pipelineInfo.pDynamicState = &state.dynamicState;
+		pipelineInfo.layout = desc.layout;
+
+		return pipelineInfo;
+	}
+
+	static PipelineBinaryKey ToBinaryKey(const vk::PipelineBinaryKeyKHR& key)
+	{
+		PipelineBinaryKey binaryKey;
+		binaryKey.size = std::min(key.keySize, static_cast<uint32_t>(PIPELINE_BINARY_KEY_SIZE));
+		memcpy(binaryKey.bytes.data(), key.key.data(), binaryKey.size);
+		return binaryKey;
+	}
+
+	// The driver's key for a full pipeline, what its binaries are archived under
+	PipelineBinaryKey GetPipelineKey(const vk::GraphicsPipelineCreateInfo& pipelineInfo) const
+	{
+		vk::PipelineCreateInfoKHR keyInfo{};
+		keyInfo.pNext = &pipelineInfo;
+		return ToBinaryKey(m_device->getPipelineKeyKHR(keyInfo));
+	}
+
+	bool HasBinaries(const GraphicsPipelineDesc& desc) const
+	{
+		if (!m_binaryArchive) return false;
+
+		const PipelineState state(desc, *m_shaderLibrary, m_inlineShaderCode);
+		return m_binaryArchive->Find(GetPipelineKey(FullPipelineInfo(state, desc))) != nullptr;
+	}
+
+	// Skips shader compilation entirely. Pipelines from binaries can't use a pipeline cache, there is nothing left for it to do.
+	vk::raii::Pipeline CreateFromBinaries(vk::GraphicsPipelineCreateInfo pipelineInfo, const std::vector<PipelineBinary>& binaries) const
+	{
+		std::vector<vk::PipelineBinaryKeyKHR> keys(binaries.size());
+		std::vector<vk::PipelineBinaryDataKHR> data(binaries.size());
+		for (size_t i = 0; i < binaries.size(); i++)
+		{
+			keys[i].keySize = binaries[i].key.size;
+			memcpy(keys[i].key.data(), binaries[i].key.bytes.data(), binaries[i].key.size);
+			data[i].dataSize = binaries[i].data.size();
+			data[i].pData = const_cast<std::byte*>(binaries[i].data.data());
+		}
+
+		vk::PipelineBinaryKeysAndDataKHR keysAndData{};
+		keysAndData.binaryCount = static_cast<uint32_t>(binaries.size());
+		keysAndData.pPipelineBinaryKeys = keys.data();
+		keysAndData.pPipelineBinaryData = data.data();
+
+		vk::PipelineBinaryCreateInfoKHR binaryCreateInfo{};
+		binaryCreateInfo.pKeysAndDataInfo = &keysAndData;
+		const std::vector<vk::raii::PipelineBinaryKHR> pipelineBinaries = m_device->createPipelineBinariesKHR(binaryCreateInfo);
+
+		std::vector<vk::PipelineBinaryKHR> handles;
+		for (const vk::raii::PipelineBinaryKHR& pipelineBinary : pipelineBinaries) handles.push_back(*pipelineBinary);
+
+		vk::PipelineBinaryInfoKHR binaryInfo{};
+		binaryInfo.pNext = pipelineInfo.pNext;
+		binaryInfo.binaryCount = static_cast<uint32_t>(handles.size());
+		binaryInfo.pPipelineBinaries = handles.data();
+		pipelineInfo.pNext = &binaryInfo;
+
+		return vk::raii::Pipeline{ *m_device, nullptr, pipelineInfo };
+	}
+
+	// Best effort, a pipeline whose binaries can't be captured just compiles again next run
+	void CaptureBinaries(const vk::raii::Pipeline& pipeline, const PipelineBinaryKey& pipelineKey) const
+	{
+		try
+		{
+			vk::PipelineBinaryCreateInfoKHR binaryCreateInfo{};
+			binaryCreateInfo.pipeline = *pipeline;
+			const std::vector<vk::raii::PipelineBinaryKHR> pipelineBinaries = m_device->createPipelineBinariesKHR(binaryCreateInfo);
+
+			std::vector<PipelineBinary> binaries;
+			for (const vk::raii::PipelineBinaryKHR& pipelineBinary : pipelineBinaries)
+			{
+				const auto [key, data] = m_device->getPipelineBinaryDataKHR(vk::PipelineBinaryDataInfoKHR{ *pipelineBinary });
+
+				PipelineBinary& binary = binaries.emplace_back();
+				binary.key = ToBinaryKey(key);
+				binary.data.resize(data.size());
+				memcpy(binary.data.data(), data.data(), data.size());
+			}
+
+			m_binaryArchive->Add(pipelineKey, std::move(binaries));
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "pipeline binary capture failed: " << e.what() << std::endl;
+		}
+
+		m_device->releaseCapturedPipelineDataKHR(vk::ReleaseCapturedPipelineDataInfoKHR{ *pipeline });
+	}
+
+	// A full pipeline for desc. With a binary archive it comes straight from stored binaries when there are some,
+	// otherwise it compiles with its binaries captured into the archive for the next run.
+	vk::raii::Pipeline CompileFull(const GraphicsPipelineDesc& desc)
+	{
+		const PipelineState state(desc, *m_shaderLibrary, m_inlineShaderCode);
+		vk::GraphicsPipelineCreateInfo pipelineInfo = FullPipelineInfo(state, desc);
+		if (!m_binaryArchive) return vk::raii::Pipeline{ *m_device, *m_pipelineCache, pipelineInfo };
+
+		const PipelineBinaryKey pipelineKey = GetPipelineKey(pipelineInfo);
+		if (const std::vector<PipelineBinary>* binaries = m_binaryArchive->Find(pipelineKey))
+		{
+			try
+			{
+				vk::raii::Pipeline pipeline = CreateFromBinaries(pipelineInfo, *binaries);
+				m_binaryLoads++;
+				return pipeline;
+			}
+			catch (const std::exception&)
+			{
+				// Binaries the driver no longer takes fall through to a compile
+			}
+		}
+
+		vk::PipelineCreateFlags2CreateInfoKHR flagsInfo{};
+		flagsInfo.pNext = pipelineInfo.pNext;
+		flagsInfo.flags = vk::PipelineCreateFlagBits2KHR::eCaptureDataKHR;
+		pipelineInfo.pNext = &flagsInfo;
+
+		// Capturing requires no pipeline cache
+		vk::raii::Pipeline pipeline{ *m_device, nullptr, pipelineInfo };
+		CaptureBinaries(pipeline, pipelineKey);
+		return pipeline;
+	}
+
+	// Builds one part with link time optimization info retained, so the background link can still optimize across parts
+	vk::raii::Pipeline CompileLibrary(const GraphicsPipelineDesc& desc, LibraryPart part) const
+	{
+		const PipelineState state(desc, *m_shaderLibrary, m_inlineShaderCode);
+
+		vk::GraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+		libraryInfo.pNext = &state.rendering;
+
+		vk::GraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.pNext = &libraryInfo;
+		pipelineInfo.flags = vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT;
+		pipelineInfo.pDynamicState = &state.dynamicState;
+
+		switch (part)
+		{
+		case LIBRARY_VERTEX_INPUT:
+			libraryInfo.flags = vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface;
+			pipelineInfo.pVertexInputState = &state.vertexInput;
+			pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+			break;
+		case LIBRARY_PRE_RASTERIZATION:
+			libraryInfo.flags = vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders;
+			pipelineInfo.stageCount = 1;
+			pipelineInfo.pStages = &state.shaderStages[0];
+			pipelineInfo.pViewportState = &state.viewport;
+			pipelineInfo.pRasterizationState = &state.rasterizer;
+			pipelineInfo.layout = desc.layout;
+			break;
+		case LIBRARY_FRAGMENT_SHADER:
+			libraryInfo.flags = vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader;
+			pipelineInfo.stageCount = 1;
+			pipelineInfo.pStages = &state.shaderStages[1];
+			pipelineInfo.pMultisampleState = &state.multisampling;
+			pipelineInfo.pDepthStencilState = &state.depthStencil;
+			pipelineInfo.layout = desc.layout;
+			break;
+		default:
+			libraryInfo.flags = vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface;
+			pipelineInfo.pMultisampleState = &state.multisampling;
+			pipelineInfo.pColorBlendState = &state.colorBlending;
+			break;
+		}
+
+		return vk::raii::Pipeline{ *m_device, *m_pipelineCache, pipelineInfo };
+	}
+
+	static vk::raii::Pipeline Link(const vk::raii::Device& device, const vk::raii::PipelineCache& pipelineCache, const GraphicsPipelineDesc& desc, const std::array<vk::Pipeline, LIBRARY_PART_COUNT>& libraries, bool optimize)
+	{
+		vk::PipelineLibraryCreateInfoKHR linkInfo{};
+		linkInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+		linkInfo.pLibraries = libraries.data();
+
+		vk::GraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.pNext = &linkInfo;
+		if (optimize) pipelineInfo.flags = vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT;
+		pipelineInfo.layout = desc.layout;
+
+		return vk::raii::Pipeline{ device, pipelineCache, pipelineInfo };
+	}
+
+	// Callers hold m_mutex
+	Library& GetLibrary(const GraphicsPipelineDesc& desc, LibraryPart part)
+	{
+		std::unique_ptr<Library>& library = m_libraries[part][LibraryKey(desc, part)];
+		if (!library) library = std::make_unique<Library>();
+		return *library;
+	}
+
+	// Callers hold m_mutex. Only links when every part is already built, which takes microseconds.
+	// A failed link is left to the compile thread, which tries again and reports it.
+	bool TryFastLink(Entry& entry)
+	{
+		std::array<vk::Pipeline, LIBRARY_PART_COUNT> libraries{};
+		for (uint32_t part = 0; part < LIBRARY_PART_COUNT; part++)
+		{
+			const Library& library = GetLibrary(entry.desc, static_cast<LibraryPart>(part));
+			if (!library.ready.load(std::memory_order_acquire)) return false;
+			libraries[part] = *library.pipeline;
+		}
+
+		try
+		{
+			entry.pipeline = Link(*m_device, *m_pipelineCache, entry.desc, libraries, false);
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+		entry.state.store(State::Ready, std::memory_order_release);
+		m_fastLinks++;
+
+		return true;
+	}
+
+	void Enqueue(std::function<void()> job)
+	{
+		m_queue.push_back(std::move(job));
+		m_queueChanged.notify_one();
+	}
+
+	// Runs on a compile thread. Parts another thread is already building are waited for, never built twice.
+	void CompileFromLibraries(Entry& entry)
+	{
+		// Archived binaries beat even a fast link, the result is already the optimized pipeline
+		if (HasBinaries(entry.desc))
+		{
+			entry.pipeline = CompileFull(entry.desc);
+			entry.state.store(State::Ready, std::memory_order_release);
+			return;
+		}
+
+		std::array<vk::Pipeline, LIBRARY_PART_COUNT> libraries{};
+		for (uint32_t part = 0; part < LIBRARY_PART_COUNT; part++)
+		{
+			Library* library = nullptr;
+			{
+				std::lock_guard lock(m_mutex);
+				library = &GetLibrary(entry.desc, static_cast<LibraryPart>(part));
+			}
+
+			std::call_once(library->built, [&]()
+			{
+				library->pipeline = CompileLibrary(entry.desc, static_cast<LibraryPart>(part));
+				library->ready.store(true, std::memory_order_release);
+			});
+			libraries[part] = *library->pipeline;
+		}
+
+		entry.pipeline = Link(*m_device, *m_pipelineCache, entry.desc, libraries, false);
+		entry.state.store(State::Ready, std::memory_order_release);
+		m_fastLinks++;
+
+		// Pipelines linked from libraries have no binaries to capture, so with an archive the optimized pipeline is compiled whole instead
+		entry.optimizedPipeline = m_binaryArchive ? CompileFull(entry.desc) : Link(*m_device, *m_pipelineCache, entry.desc, libraries, true);
+		entry.optimized.store(true, std::memory_order_release);
+	}
+
+	void CompileShaderObjects(Entry& entry)
+	{
+		const std::span<const uint32_t> code = m_shaderLibrary->GetCode(entry.desc.shader);
+		if (code.empty()) throw std::runtime_error("unknown shader in pipeline description");
+
+		const LayoutInterface* layoutInterface = nullptr;
+		{
+			std::lock_guard lock(m_mutex);
+			layoutInterface = &m_layoutInterfaces.at(entry.desc.layout);
+		}
+
+		const SpecializationState specialization(entry.desc);
+
+		std::array<vk::ShaderCreateInfoEXT, 2> shaderInfos{};
+		for (vk::ShaderCreateInfoEXT& shaderInfo : shaderInfos)
+		{
+			shaderInfo.flags = vk::ShaderCreateFlagBitsEXT::eLinkStage;
+			shaderInfo.codeType = vk::ShaderCodeTypeEXT::eSpirv;
+			shaderInfo.codeSize = code.size_bytes();
+			shaderInfo.pCode = code.data();
+			shaderInfo.setLayoutCount = static_cast<uint32_t>(layoutInterface->setLayouts.size());
+			shaderInfo.pSetLayouts = layoutInterface->setLayouts.data();
+			shaderInfo.pushConstantRangeCount = static_cast<uint32_t>(layoutInterface->pushConstantRanges.size());
+			shaderInfo.pPushConstantRanges = layoutInterface->pushConstantRanges.data();
+			shaderInfo.pSpecializationInfo = &specialization.info;
+		}
+		shaderInfos[0].stage = vk::ShaderStageFlagBits::eVertex;
+		shaderInfos[0].nextStage = vk::ShaderStageFlagBits::eFragment;
+		shaderInfos[0].pName = entry.desc.vertexEntryPoint.data();
+		shaderInfos[1].stage = vk::ShaderStageFlagBits::eFragment;
+		shaderInfos[1].pName = entry.desc.fragmentEntryPoint.data();
+
+		std::vector<vk::raii::ShaderEXT> shaders = m_device->createShadersEXT(shaderInfos);
+		entry.vertexShader = std::move(shaders[0]);
+		entry.fragmentShader = std::move(shaders[1]);
+		entry.state.store(State::Ready, std::memory_order_release);
+	}
+
+	void CompileEntry(Entry& entry)
+	{
+		try
+		{
+			if (m_backend == PipelineBackend::Library) CompileFromLibraries(entry);
+			else if (m_backend == PipelineBackend::ShaderObject) CompileShaderObjects(entry);
+			else
+			{
+				entry.pipeline = CompileFull(entry.desc);
+				entry.state.store(State::Ready, std::memory_order_release);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "pipeline compile failed: " << e.what() << std::endl;
+			if (entry.state.load() == State::Compiling) entry.state.store(State::Failed, std::memory_order_release);
+		}
+	}
+
+	void OptimizeEntry(Entry& entry)
+	{
+		try
+		{
+			if (m_binaryArchive) entry.optimizedPipeline = CompileFull(entry.desc);
+			else
+			{
+				std::array<vk::Pipeline, LIBRARY_PART_COUNT> libraries{};
+				{
+					std::lock_guard lock(m_mutex);
+					for (uint32_t part = 0; part < LIBRARY_PART_COUNT; part++) libraries[part] = *GetLibrary(entry.desc, static_cast<LibraryPart>(part)).pipeline;
+				}
+
+				entry.optimizedPipeline = Link(*m_device, *m_pipelineCache, entry.desc, libraries, true);
+			}
+			entry.optimized.store(true, std::memory_order_release);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "pipeline optimized link failed: " << e.what() << std::endl;
+		}
+	}
+
+	void CompileLoop()
+	{
+		while (true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock lock(m_mutex);
+				m_queueChanged.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+				if (m_stopping) return;
+
+				job = std::move(m_queue.front());
+				m_queue.pop_front();
+				m_compiling++;
+			}
+
+			const auto start = std::chrono::steady_clock::now();
+			job();
+			m_compileMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+			std::lock_guard lock(m_mutex);
+			m_compiling--;
+			if (m_queue.empty() && m_compiling == 0) m_idle.notify_all();
+		}
+	}
+
+public:
+	PipelineRegistry() = default;
+	PipelineRegistry(const PipelineRegistry&) = delete;
+	PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+	~PipelineRegistry() { Shutdown(); }
+
+	// All three have to outlive the registry, or at least its Shutdown. The device must have the backend's extension and feature enabled,
+	// and VK_KHR_maintenance5 for inlineShaderCode, which hands pipelines the library's code instead of creating modules from it.
+	void Init(const vk::raii::Device& device, const vk::raii::PipelineCache& pipelineCache, ShaderLibrary& shaderLibrary, PipelineBackend backend, bool inlineShaderCode)
+	{
+		m_device = &device;
+		m_pipelineCache = &pipelineCache;
+		m_shaderLibrary = &shaderLibrary;
+		m_backend = backend;
+		m_inlineShaderCode = inlineShaderCode;
+
+		const uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency() / 4);
+		for (uint32_t i = 0; i < threadCount; i++) m_threads.emplace_back([this]() { CompileLoop(); });
+	}
+
+	// Finishes the compiles in flight, drops the queued ones and destroys every pipeline
+	void Shutdown()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stopping = true;
+			m_queue.clear();
+		}
+		m_queueChanged.notify_all();
+		m_threads.clear();
+		m_entries.clear();
+		for (auto& libraries : m_libraries) libraries.clear();
+		m_stopping = false;
+	}
+
+	PipelineBackend GetBackend() const { return m_backend; }
+
+	// VK_KHR_pipeline_binary, set before the first request. Full pipelines are then created from the archive's binaries when
+	// it has them and have theirs captured into it when it doesn't. Shader objects don't use it.
+	void SetBinaryArchive(PipelineBinaryArchive* archive) { m_binaryArchive = archive; }
+
+	// Shader object backend only, it compiles against set layouts rather than pipeline layouts.
+	// Register every layout descriptions refer to before requesting them.
+	void SetLayoutInterface(vk::PipelineLayout layout, std::vector<vk::DescriptorSetLayout> setLayouts, std::vector<vk::PushConstantRange> pushConstantRanges)
+	{
+		std::lock_guard lock(m_mutex);
+		m_layoutInterfaces[layout] = { std::move(setLayouts), std::move(pushConstantRanges) };
+	}
+
+	// What to bind for desc, or an empty handle while it is still compiling or if it failed to compile.
+	// The first request for a description queues its compile, or with the library backend fast links it on the spot when its parts exist.
+	GraphicsPipelineHandle Request(const GraphicsPipelineDesc& desc)
+	{
+		std::lock_guard lock(m_mutex);
+
+		auto [it, inserted] = m_entries.try_emplace(desc);
+		if (inserted)
+		{
+			it->second = std::make_unique<Entry>();
+			Entry* entry = it->second.get();
+			entry->desc = desc;
+
+			if (m_backend == PipelineBackend::Library && TryFastLink(*entry)) Enqueue([this, entry]() { OptimizeEntry(*entry); });
+			else Enqueue([this, entry]() { CompileEntry(*entry); });
+		}
+
+		const Entry& entry = *it->second;
+		if (entry.state.load(std::memory_order_acquire) != State::Ready) return {};
+
+		GraphicsPipelineHandle handle{ &entry.desc };
+		if (m_backend == PipelineBackend::ShaderObject)
+		{
+			handle.vertexShader = *entry.vertexShader;
+			handle.fragmentShader = *entry.fragmentShader;
+		}
+		else handle.pipeline = entry.optimized.load(std::memory_order_acquire) ? *entry.optimizedPipeline : *entry.pipeline;
+
+		return handle;
+	}
+
+	// Binds a ready handle. Shader objects have no baked state, so all of it is set here from the description.
+	static void Bind(const vk::raii::CommandBuffer& commandBuffer, const GraphicsPipelineHandle& handle)
+	{
+		if (handle.pipeline)
+		{
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, handle.pipeline);
+			return;
+		}
+
+		const GraphicsPipelineDesc& desc = *handle.desc;
+		commandBuffer.bindShadersEXT({ vk::ShaderStageFlagBits::eVertex, vk::ShaderStageFlagBits::eFragment }, { handle.vertexShader, handle.fragmentShader });
+
+		std::vector<vk::VertexInputBindingDescription2EXT> bindings;
+		std::vector<vk::VertexInputAttributeDescription2EXT> attributes;
+		if (desc.vertexStride)
+		{
+			bindings.emplace_back(0, desc.vertexStride, vk::VertexInputRate::eVertex, 1);
+			for (uint32_t location = 0; location < desc.vertexAttributes.size(); location++)
+			{
+				const PipelineVertexAttribute& attribute = desc.vertexAttributes[location];
+				if (attribute.format == vk::Format::eUndefined) break;
+				attributes.emplace_back(location, 0, attribute.format, attribute.offset);
+			}
+		}
+		commandBuffer.setVertexInputEXT(bindings, attributes);
+		commandBuffer.setPrimitiveTopology(desc.topology);
+		commandBuffer.setPrimitiveRestartEnable(vk::False);
+
+		commandBuffer.setRasterizerDiscardEnable(vk::False);
+		commandBuffer.setPolygonModeEXT(desc.polygonMode);
+		commandBuffer.setCullMode(desc.cullMode);
+		commandBuffer.setFrontFace(desc.frontFace);
+		commandBuffer.setDepthBiasEnable(vk::False);
+		commandBuffer.setRasterizationSamplesEXT(vk::SampleCountFlagBits::e1);
+		commandBuffer.setSampleMaskEXT(vk::SampleCountFlagBits::e1, vk::SampleMask{ ~0u });
+		commandBuffer.setAlphaToCoverageEnableEXT(vk::False);
+
+		commandBuffer.setDepthTestEnable(desc.depthTest != 0);
+		commandBuffer.setDepthWriteEnable(desc.depthWrite != 0);
+		commandBuffer.setDepthCompareOp(desc.depthCompare);
+		commandBuffer.setStencilTestEnable(vk::False);
+
+		const vk::PipelineColorBlendAttachmentState blend = BlendAttachment(desc.blend);
+		commandBuffer.setColorBlendEnableEXT(0, blend.blendEnable);
+		commandBuffer.setColorWriteMaskEXT(0, blend.colorWriteMask);
+		if (blend.blendEnable)
+		{
+			const vk::ColorBlendEquationEXT equation
+			{
+				blend.srcColorBlendFactor,
+				blend.dstColorBlendFactor,
+				blend.colorBlendOp,
+				blend.srcAlphaBlendFactor,
+				blend.dstAlphaBlendFactor,
+				blend.alphaBlendOp
+			};
+			commandBuffer.setColorBlendEquationEXT(0, equation);
+		}
+	}
+
+	// Blocks until nothing is queued or compiling. For load screens and shutdown, never for a frame.
+	void WaitIdle()
+	{
+		std::unique_lock lock(m_mutex);
+		m_idle.wait(lock, [this]() { return m_queue.empty() && m_compiling == 0; });
+	}
+
+	size_t GetPipelineCount()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_entries.size();
+	}
+
+	// Library backend: pipelines that went through a fast link, whether inside Request or after their parts were built
+	uint64_t GetFastLinkCount() const { return m_fastLinks.load(); }
+
+	// Pipelines created from archived binaries, without compiling anything
+	uint64_t GetBinaryLoadCount() const { return m_binaryLoads.load(); }
+
+	// Summed over every compile so far, across all threads
+	double GetCompileMilliseconds() const { return static_cast<double>(m_compileMicroseconds.load()) / 1000.0; }
+};
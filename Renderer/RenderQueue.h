@@ -0,0 +1,156 @@
+#pragma once
+
+#include "Parallel.h"
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+enum class DrawPass : uint32_t
+{
+	Opaque,
+	Transparent
+};
+
+// 64 bit sort key, most significant field first, so sorting the keys orders draws by state.
+// Opaque:      pass | pipeline | material | mesh | lod | depth, front to back so early depth testing rejects more.
+// Transparent: pass | depth | pipeline | material | mesh | lod, back to front since blending needs that order over state.
+struct DrawKey
+{
+	static constexpr uint32_t PASS_BITS = 2;
+	static constexpr uint32_t PIPELINE_BITS = 8;
+	static constexpr uint32_t MATERIAL_BITS = 14;
+	static constexpr uint32_t MESH_BITS = 20;
+	static constexpr uint32_t LOD_BITS = 4;
+	static constexpr uint32_t DEPTH_BITS = 16;
+	static_assert(PASS_BITS + PIPELINE_BITS + MATERIAL_BITS + MESH_BITS + LOD_BITS + DEPTH_BITS == 64);
+
+	static constexpr uint32_t STATE_BITS = PIPELINE_BITS + MATERIAL_BITS + MESH_BITS + LOD_BITS;
+	static constexpr uint64_t DEPTH_MAX = (uint64_t{ 1 } << DEPTH_BITS) - 1;
+
+	// depth is the view depth divided by the far plane, 0 at the camera. Fields wider than their bits are truncated.
+	static uint64_t Make(DrawPass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t lod, float depth)
+	{
+		auto field = [](uint64_t value, uint32_t bits) { return value & ((uint64_t{ 1 } << bits) - 1); };
+
+		uint64_t state = field(pipeline, PIPELINE_BITS);
+		state = (state << MATERIAL_BITS) | field(material, MATERIAL_BITS);
+		state = (state << MESH_BITS) | field(mesh, MESH_BITS);
+		state = (state << LOD_BITS) | field(lod, LOD_BITS);
+
+		const uint64_t quantizedDepth = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(DEPTH_MAX) + 0.5f);
+		const uint64_t passBits = field(static_cast<uint64_t>(pass), PASS_BITS) << (64 - PASS_BITS);
+
+		if (pass == DrawPass::Transparent) return passBits | ((DEPTH_MAX - quantizedDepth) << STATE_BITS) | state;
+		return passBits | (state << DEPTH_BITS) | quantizedDepth;
+	}
+};
+
+// Draws of a frame as key and item pairs, item being whatever index the caller records from.
+// Sorting is an LSD radix sort on 8 bit digits: every pass counts digits per chunk in parallel, turns the counts into
+// offsets serially and scatters in parallel. Chunks scatter in order, so each pass is stable and the whole sort is too.
+// Digits that are the same in every key are skipped, which is most of them since the high fields rarely use all their bits.
+class RenderQueue
+{
+	static constexpr size_t CHUNK_SIZE = 16384;
+	static constexpr uint32_t DIGIT_BITS = 8;
+	static constexpr uint32_t DIGIT_COUNT = 1 << DIGIT_BITS;
+
+	std::vector<uint64_t> m_keys;
+	std::vector<uint32_t> m_items;
+	std::vector<uint64_t> m_scratchKeys;
+	std::vector<uint32_t> m_scratchItems;
+	std::vector<std::array<uint32_t, DIGIT_COUNT>> m_chunkOffsets;
+	std::vector<uint64_t> m_chunkVaryingBits;
+
+public:
+	// Sized up front so keys can be filled in from several threads
+	void Resize(size_t count)
+	{
+		m_keys.resize(count);
+		m_items.resize(count);
+	}
+
+	void Set(size_t index, uint64_t key, uint32_t item)
+	{
+		m_keys[index] = key;
+		m_items[index] = item;
+	}
+
+	size_t Size() const { return m_keys.size(); }
+	uint64_t GetKey(size_t index) const { return m_keys[index]; }
+	uint32_t GetItem(size_t index) const { return m_items[index]; }
+
+	void Sort()
+	{
+		const size_t count = m_keys.size();
+		if (count <= 1) return;
+
+		const size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		auto chunkEnd = [count](size_t chunk) { return std::min(count, (chunk + 1) * CHUNK_SIZE); };
+
+		// Bits that differ from the first key anywhere
+		m_chunkVaryingBits.resize(chunkCount);
+		ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t chunk = begin; chunk < end; chunk++)
+			{
+				uint64_t varying = 0;
+				for (size_t i = chunk * CHUNK_SIZE; i < chunkEnd(chunk); i++) varying |= m_keys[i] ^ m_keys[0];
+				m_chunkVaryingBits[chunk] = varying;
+			}
+		});
+
+		uint64_t varyingBits = 0;
+		for (uint64_t varying : m_chunkVaryingBits) varyingBits |= varying;
+
+		m_scratchKeys.resize(count);
+		m_scratchItems.resize(count);
+		m_chunkOffsets.resize(chunkCount);
+
+		for (uint32_t shift = 0; shift < 64; shift += DIGIT_BITS)
+		{
+			if (((varyingBits >> shift) & (DIGIT_COUNT - 1)) == 0) continue;
+
+			ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+			{
+				for (size_t chunk = begin; chunk < end; chunk++)
+				{
+					std::array<uint32_t, DIGIT_COUNT>& counts = m_chunkOffsets[chunk];
+					counts.fill(0);
+					for (size_t i = chunk * CHUNK_SIZE; i < chunkEnd(chunk); i++) counts[(m_keys[i] >> shift) & (DIGIT_COUNT - 1)]++;
+				}
+			});
+
+			// Digit major, so a digit's keys from earlier chunks land before those from later ones
+			uint32_t offset = 0;
+			for (uint32_t digit = 0; digit < DIGIT_COUNT; digit++)
+			{
+				for (std::array<uint32_t, DIGIT_COUNT>& offsets : m_chunkOffsets)
+				{
+					const uint32_t digitCount = offsets[digit];
+					offsets[digit] = offset;
+					offset += digitCount;
+				}
+			}
+
+			ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+			{
+				for (size_t chunk = begin; chunk < end; chunk++)
+				{
+					std::array<uint32_t, DIGIT_COUNT>& offsets = m_chunkOffsets[chunk];
+					for (size_t i = chunk * CHUNK_SIZE; i < chunkEnd(chunk); i++)
+					{
+						const uint32_t destination = offsets[(m_keys[i] >> shift) & (DIGIT_COUNT - 1)]++;
+						m_scratchKeys[destination] = m_keys[i];
+						m_scratchItems[destination] = m_items[i];
+					}
+				}
+			});
+
+			m_keys.swap(m_scratchKeys);
+			m_items.swap(m_scratchItems);
+		}
+	}
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include "Parallel.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__AVX__) || defined(__AVX2__)
+#include <immintrin.h>
+#define SCENE_GRAPH_AVX 1
+#elif defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SCENE_GRAPH_SSE 1
+#endif
+
+using SceneNode = uint32_t;
+constexpr SceneNode INVALID_SCENE_NODE = ~0u;
+
+// Transform hierarchy stored as structure of arrays, kept in depth first order so parents come before children
+// and every subtree is one contiguous range. Handles returned by CreateNode stay valid across the reordering.
+class SceneGraph
+{
+	static constexpr uint32_t NO_PARENT = ~0u;
+
+	// Indexed by storage slot
+	std::vector<glm::vec3> m_positions;
+	std::vector<glm::quat> m_rotations;
+	std::vector<glm::vec3> m_scales;
+	std::vector<uint32_t> m_parents;
+	std::vector<uint32_t> m_subtreeEnds;
+	std::vector<glm::mat4> m_localMatrices;
+	std::vector<glm::mat4> m_worldMatrices;
+	std::vector<uint8_t> m_localDirty;
+	std::vector<uint8_t> m_worldDirty;
+	std::vector<SceneNode> m_slotToNode;
+
+	std::vector<uint32_t> m_nodeToSlot;
+
+	// Slots updated serially before the parallel part, and the subtree ranges handed to workers
+	std::vector<uint32_t> m_topSlots;
+	std::vector<uint32_t> m_subtreeTasks;
+
+	bool m_orderDirty = false;
+	bool m_anyLocalDirty = false;
+
+	// results[i] = parent * locals[i] for a run of siblings, so the parent is loaded once for all of them
+	static void MultiplyRun(const glm::mat4& parent, const glm::mat4* locals, glm::mat4* results, size_t count)
+	{
+#if defined(SCENE_GRAPH_AVX)
+		// Two result columns per step, each half of the register is one column. Both local columns are loaded together and
+		// each of their elements is spread across its half by an in-lane shuffle.
+		const float* p = &parent[0][0];
+		const __m256 p0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(p + 0));
+		const __m256 p1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(p + 4));
+		const __m256 p2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(p + 8));
+		const __m256 p3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(p + 12));
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* l = &locals[i][0][0];
+			float* result = &results[i][0][0];
+			for (int c = 0; c < 16; c += 8)
+			{
+				const __m256 columns = _mm256_loadu_ps(l + c);
+				__m256 r = _mm256_mul_ps(p0, _mm256_shuffle_ps(columns, columns, 0x00));
+				r = _mm256_add_ps(r, _mm256_mul_ps(p1, _mm256_shuffle_ps(columns, columns, 0x55)));
+				r = _mm256_add_ps(r, _mm256_mul_ps(p2, _mm256_shuffle_ps(columns, columns, 0xAA)));
+				r = _mm256_add_ps(r, _mm256_mul_ps(p3, _mm256_shuffle_ps(columns, columns, 0xFF)));
+				_mm256_storeu_ps(result + c, r);
+			}
+		}
+#elif defined(SCENE_GRAPH_SSE)
+		const __m128 p0 = _mm_loadu_ps(&parent[0][0]);
+		const __m128 p1 = _mm_loadu_ps(&parent[1][0]);
+		const __m128 p2 = _mm_loadu_ps(&parent[2][0]);
+		const __m128 p3 = _mm_loadu_ps(&parent[3][0]);
+		for (size_t i = 0; i < count; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				const __m128 column = _mm_loadu_ps(&locals[i][c][0]);
+				__m128 r = _mm_mul_ps(p0, _mm_shuffle_ps(column, column, 0x00));
+				r = _mm_add_ps(r, _mm_mul_ps(p1, _mm_shuffle_ps(column, column, 0x55)));
+				r = _mm_add_ps(r, _mm_mul_ps(p2, _mm_shuffle_ps(column, column, 0xAA)));
+				r = _mm_add_ps(r, _mm_mul_ps(p3, _mm_shuffle_ps(column, column, 0xFF)));
+				_mm_storeu_ps(&results[i][c][0], r);
+			}
+		}
+#else
+		for (size_t i = 0; i < count; i++) results[i] = parent * locals[i];
+#endif
+	}
+
+	void ComposeLocal(uint32_t slot)
+	{
+		glm::mat4& m = m_localMatrices[slot];
+		m = glm::mat4_cast(m_rotations[slot]);
+		m[0] *= m_scales[slot].x;
+		m[1] *= m_scales[slot].y;
+		m[2] *= m_scales[slot].z;
+		m[3] = glm::vec4(m_positions[slot], 1.0f);
+	}
+
+	// Updates the slots [begin, end) of a depth first range whose parents outside it are already up to date.
+	// One pass settles which slots change and recomposes their local matrices, then world matrices are computed for runs of
+	// consecutive changed slots sharing a parent. Depth first order puts the leaf children of a node next to each other,
+	// so most of the hierarchy goes through MultiplyRun in long runs.
+	void UpdateRange(uint32_t begin, uint32_t end)
+	{
+		for (uint32_t slot = begin; slot < end; slot++)
+		{
+			const uint32_t parent = m_parents[slot];
+			m_worldDirty[slot] = m_localDirty[slot] | (parent != NO_PARENT ? m_worldDirty[parent] : uint8_t{ 0 });
+			if (!m_localDirty[slot]) continue;
+
+			ComposeLocal(slot);
+			m_localDirty[slot] = 0;
+		}
+
+		for (uint32_t slot = begin; slot < end;)
+		{
+			if (!m_worldDirty[slot])
+			{
+				slot++;
+				continue;
+			}
+
+			const uint32_t parent = m_parents[slot];
+			uint32_t runEnd = slot + 1;
+			while (runEnd < end && m_worldDirty[runEnd] && m_parents[runEnd] == parent) runEnd++;
+
+			if (parent == NO_PARENT) std::copy(m_localMatrices.begin() + slot, m_localMatrices.begin() + runEnd, m_worldMatrices.begin() + slot);
+			else MultiplyRun(m_worldMatrices[parent], &m_localMatrices[slot], &m_worldMatrices[slot], runEnd - slot);
+
+			slot = runEnd;
+		}
+	}
+
+	template<typename T>
+	static void Permute(std::vector<T>& values, const std::vector<uint32_t>& order)
+	{
+		std::vector<T> sorted(values.size());
+		for (size_t i = 0; i < order.size(); i++) sorted[i] = values[order[i]];
+		values.swap(sorted);
+	}
+
+	// Depth first reorder, then pick the depth at which subtrees are split between workers
+	void Reorder()
+	{
+		const uint32_t count = static_cast<uint32_t>(m_parents.size());
+
+		std::vector<uint32_t> childOffsets(count + 1, 0);
+		for (uint32_t parent : m_parents) if (parent != NO_PARENT) childOffsets[parent + 1]++;
+		for (uint32_t i = 0; i < count; i++) childOffsets[i + 1] += childOffsets[i];
+		std::vector<uint32_t> children(childOffsets[count]);
+		{
+			std::vector<uint32_t> fill(childOffsets.begin(), childOffsets.end() - 1);
+			for (uint32_t i = 0; i < count; i++) if (m_parents[i] != NO_PARENT) children[fill[m_parents[i]]++] = i;
+		}
+
+		std::vector<uint32_t> order;
+		std::vector<uint32_t> stack;
+		order.reserve(count);
+		for (uint32_t root = 0; root < count; root++)
+		{
+			if (m_parents[root] != NO_PARENT) continue;
+
+			stack.push_back(root);
+			while (!stack.empty())
+			{
+				const uint32_t slot = stack.back();
+				stack.pop_back();
+				order.push_back(slot);
+				for (uint32_t c = childOffsets[slot + 1]; c > childOffsets[slot]; c--) stack.push_back(children[c - 1]);
+			}
+		}
+
+		std::vector<uint32_t> oldToNew(count);
+		for (uint32_t i = 0; i < count; i++) oldToNew[order[i]] = i;
+
+		Permute(m_positions, order);
+		Permute(m_rotations, order);
+		Permute(m_scales, order);
+		Permute(m_parents, order);
+		Permute(m_localMatrices, order);
+		Permute(m_worldMatrices, order);
+		Permute(m_localDirty, order);
+		Permute(m_worldDirty, order);
+		Permute(m_slotToNode, order);
+		for (uint32_t& parent : m_parents) if (parent != NO_PARENT) parent = oldToNew[parent];
+		for (uint32_t slot = 0; slot < count; slot++) m_nodeToSlot[m_slotToNode[slot]] = slot;
+
+		// Subtree ends and depths, walking backwards so children are finished before their parents
+		std::vector<uint32_t> depths(count, 0);
+		m_subtreeEnds.assign(count, 0);
+		for (uint32_t slot = 0; slot < count; slot++)
+		{
+			m_subtreeEnds[slot] = slot + 1;
+			if (m_parents[slot] != NO_PARENT) depths[slot] = depths[m_parents[slot]] + 1;
+		}
+		for (uint32_t slot = count; slot-- > 0;)
+		{
+			if (m_parents[slot] != NO_PARENT) m_subtreeEnds[m_parents[slot]] = std::max(m_subtreeEnds[m_parents[slot]], m_subtreeEnds[slot]);
+		}
+
+		// Go deeper until there are enough subtrees to keep every thread busy
+		const size_t wantedTasks = std::max<size_t>(1, std::thread::hardware_concurrency()) * 4;
+		const uint32_t maxDepth = count ? *std::ranges::max_element(depths) : 0;
+		uint32_t splitDepth = 0;
+		for (; splitDepth < maxDepth; splitDepth++)
+		{
+			if (static_cast<size_t>(std::ranges::count(depths, splitDepth)) >= wantedTasks) break;
+		}
+
+		m_topSlots.clear();
+		m_subtreeTasks.clear();
+		for (uint32_t slot = 0; slot < count; slot++)
+		{
+			if (depths[slot] < splitDepth) m_topSlots.push_back(slot);
+			else if (depths[slot] == splitDepth) m_subtreeTasks.push_back(slot);
+		}
+
+		m_orderDirty = false;
+	}
+
+public:
+	SceneNode CreateNode(SceneNode parent = INVALID_SCENE_NODE)
+	{
+		const SceneNode node = static_cast<SceneNode>(m_nodeToSlot.size());
+		const uint32_t slot = static_cast<uint32_t>(m_parents.size());
+
+		m_positions.emplace_back(0.0f);
+		m_rotations.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+		m_scales.emplace_back(1.0f);
+		m_parents.push_back(parent == INVALID_SCENE_NODE ? NO_PARENT : m_nodeToSlot[parent]);
+		m_localMatrices.emplace_back(1.0f);
+		m_worldMatrices.emplace_back(1.0f);
+		m_localDirty.push_back(1);
+		m_worldDirty.push_back(1);
+		m_slotToNode.push_back(node);
+		m_nodeToSlot.push_back(slot);
+
+		m_orderDirty = true;
+		m_anyLocalDirty = true;
+
+		return node;
+	}
+
+	void SetLocalTransform(SceneNode node, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		const uint32_t slot = m_nodeToSlot[node];
+		m_positions[slot] = position;
+		m_rotations[slot] = rotation;
+		m_scales[slot] = scale;
+		m_localDirty[slot] = 1;
+		m_anyLocalDirty = true;
+	}
+
+	void SetPosition(SceneNode node, const glm::vec3& position) { SetLocalTransform(node, position, m_rotations[m_nodeToSlot[node]], m_scales[m_nodeToSlot[node]]); }
+	void SetRotation(SceneNode node, const glm::quat& rotation) { SetLocalTransform(node, m_positions[m_nodeToSlot[node]], rotation, m_scales[m_nodeToSlot[node]]); }
+
+	const glm::mat4& GetWorldMatrix(SceneNode node) const { return m_worldMatrices[m_nodeToSlot[node]]; }
+
+	// True if the node's world matrix changed during the last Update
+	bool WasWorldUpdated(SceneNode node) const { return m_worldDirty[m_nodeToSlot[node]] != 0; }
+
+	size_t GetNodeCount() const { return m_parents.size(); }
+
+	// Recomposes dirty local matrices and pushes world matrices down only the dirty parts of the hierarchy
+	void Update()
+	{
+		std::ranges::fill(m_worldDirty, uint8_t{ 0 });
+		if (!m_anyLocalDirty) return;
+		if (m_orderDirty) Reorder();
+
+		for (uint32_t slot : m_topSlots) UpdateRange(slot, slot + 1);
+
+		ParallelFor(m_subtreeTasks.size(), 1, [this](size_t begin, size_t end)
+		{
+			for (size_t task = begin; task < end; task++)
+			{
+				const uint32_t root = m_subtreeTasks[task];
+				UpdateRange(root, m_subtreeEnds[root]);
+			}
+		});
+
+		m_anyLocalDirty = false;
+	}
+};
+
+// Updates a hierarchy of nodeCount nodes with the root turning every time, so every world matrix is recomputed, and
+// reports the average milliseconds per update. Groups of a hundred leaves hang off nodes under the root.
+inline double BenchmarkSceneUpdate(size_t nodeCount, int iterations)
+{
+	SceneGraph scene;
+	const SceneNode root = scene.CreateNode();
+	SceneNode group = INVALID_SCENE_NODE;
+	for (size_t i = 1; i < nodeCount; i++)
+	{
+		if (i % 100 == 1) group = scene.CreateNode(root);
+		else scene.SetPosition(scene.CreateNode(group), glm::vec3(static_cast<float>(i % 100), 0.0f, 0.0f));
+	}
+	scene.Update();
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		scene.SetRotation(root, glm::angleAxis(0.01f * static_cast<float>(i), glm::vec3(0.0f, 0.0f, 1.0f)));
+		scene.Update();
+	}
+	const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	return milliseconds / iterations;
+}
@@ -1 +1,3 @@
-C:/VulkanSDK/1.4.328.1/bin/slangc.exe Shader.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry vertMain -entry fragMain -o Slang.spv
\ No newline at end of file
+"%VULKAN_SDK%/bin/slangc.exe" Shader.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry vertMain -entry vertPulledMain -entry vertIndirectMain -entry fragMain -o Draw.spv || exit /b 1
+"%VULKAN_SDK%/bin/slangc.exe" Shader.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry cullMain -o Cull.spv || exit /b 1
+"%VULKAN_SDK%/bin/slangc.exe" Shader.slang -target spirv -profile spirv_1_4 -emit-spirv-directly -fvk-use-entrypoint-name -entry buildDepthPyramidMain -o DepthPyramid.spv || exit /b 1
\ No newline at end of file
@@ -0,0 +1,358 @@
+#pragma once
+
+#include "Hash.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "ShaderLibrary.h"
+
+#include <slang.h>
+#include <slang-com-ptr.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <stdexcept>
+#include <filesystem>
+
+// One SPIR-V module to build: entry points of a source file under a set of defines, added to the shader library as name
+struct ShaderCompileRequest
+{
+	std::string name;
+	std::filesystem::path source;
+	std::vector<std::string> entryPoints;
+	std::vector<std::pair<std::string, std::string>> defines;
+};
+
+// Shader cache entry: ShaderCacheHeader | dependencies | code
+//   dependency: ShaderCacheDependency | path padded to 8 bytes
+// Entries are named by the request key, a hash of the source, entry points, defines, target and compiler build. What the source
+// includes is only known once it has been compiled, so every file it read is listed with its content hash and checked on load.
+constexpr uint32_t SHADER_CACHE_MAGIC = 0x43565053; // "SPVC"
+constexpr uint32_t SHADER_CACHE_VERSION = 1;
+constexpr uint64_t SHADER_CACHE_ALIGNMENT = 8;
+
+struct ShaderCacheHeader
+{
+	uint32_t magic = SHADER_CACHE_MAGIC;
+	uint32_t version = SHADER_CACHE_VERSION;
+	uint64_t key = 0;
+	uint32_t dependencyCount = 0;
+	uint32_t reserved = 0;
+	uint64_t codeSize = 0;
+	uint64_t codeHash = 0;
+};
+
+struct ShaderCacheDependency
+{
+	uint64_t contentHash = 0;
+	uint32_t pathSize = 0;
+	uint32_t reserved = 0;
+};
+
+// Compiles Slang to SPIR-V at runtime through the Slang API, so editing a shader needs no offline step on any platform.
+// Results are cached on disk, a request whose inputs are unchanged loads the cached code and never creates a Slang session.
+class ShaderCompiler
+{
+	static constexpr const char* TARGET_PROFILE = "spirv_1_4";
+
+	std::filesystem::path m_cacheDirectory;
+
+	// Global sessions aren't thread safe and are slow to create, so each compile borrows one of its own and returns it for the next
+	std::mutex m_mutex;
+	std::vector<Slang::ComPtr<slang::IGlobalSession>> m_globalSessions;
+
+	std::atomic<uint32_t> m_cacheHits{ 0 };
+	std::atomic<uint32_t> m_compiles{ 0 };
+
+	static uint64_t Align(uint64_t offset) { return (offset + SHADER_CACHE_ALIGNMENT - 1) / SHADER_CACHE_ALIGNMENT * SHADER_CACHE_ALIGNMENT; }
+
+	static uint64_t HashFile(const std::filesystem::path& path)
+	{
+		const MappedFile file(path);
+		return HashBytes(file.Bytes());
+	}
+
+	static uint64_t RequestKey(const ShaderCompileRequest& request, uint64_t sourceHash)
+	{
+		uint64_t hash = HashCombine(HashValue(SHADER_CACHE_VERSION), sourceHash);
+		hash = HashString(spGetBuildTagString(), hash);
+		hash = HashString(TARGET_PROFILE, hash);
+		hash = HashCombine(hash, request.entryPoints.size());
+		for (const std::string& entryPoint : request.entryPoints) hash = HashString(entryPoint, hash);
+		hash = HashCombine(hash, request.defines.size());
+		for (const auto& [name, value] : request.defines) hash = HashString(value, HashString(name, hash));
+		return hash;
+	}
+
+	std::filesystem::path GetCachePath(uint64_t key) const
+	{
+		char hashName[17]{};
+		std::to_chars(hashName, hashName + 16, key, 16);
+		return m_cacheDirectory / (std::string(hashName) + ".spv");
+	}
+
+	// The cached code for key, false when there is none or a file it was built from has changed since
+	static bool LoadCached(const std::filesystem::path& path, uint64_t key, std::vector<uint32_t>& code)
+	{
+		std::error_code error;
+		if (!std::filesystem::exists(path, error)) return false;
+
+		const MappedFile file(path);
+		const std::span<const std::byte> bytes = file.Bytes();
+		if (bytes.size() < sizeof(ShaderCacheHeader)) return false;
+
+		ShaderCacheHeader header;
+		memcpy(&header, bytes.data(), sizeof(header));
+		if (header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION || header.key != key) return false;
+
+		uint64_t offset = sizeof(ShaderCacheHeader);
+		for (uint32_t i = 0; i < header.dependencyCount; i++)
+		{
+			ShaderCacheDependency dependency;
+			if (offset + sizeof(dependency) > bytes.size()) return false;
+			memcpy(&dependency, bytes.data() + offset, sizeof(dependency));
+			offset += sizeof(dependency);
+			if (offset + dependency.pathSize > bytes.size()) return false;
+
+			const std::filesystem::path dependencyPath(std::string(reinterpret_cast<const char*>(bytes.data() + offset), dependency.pathSize));
+			if (!std::filesystem::exists(dependencyPath, error) || HashFile(dependencyPath) != dependency.contentHash) return false;
+			offset = Align(offset + dependency.pathSize);
+		}
+
+		if (header.codeSize == 0 || header.codeSize % sizeof(uint32_t) != 0 || offset + header.codeSize != bytes.size()) return false;
+
+		const std::span<const std::byte> codeBytes = bytes.subspan(offset);
+		uint32_t magic = 0;
+		memcpy(&magic, codeBytes.data(), sizeof(magic));
+		if (magic != SPIRV_MAGIC || HashBytes(codeBytes) != header.codeHash) return false;
+
+		code.resize(header.codeSize / sizeof(uint32_t));
+		memcpy(code.data(), codeBytes.data(), header.codeSize);
+		return true;
+	}
+
+	// Writes next to the destination and renames over it, so a crash never leaves a torn entry behind. Returns false if nothing was written.
+	static bool WriteCached(const std::filesystem::path& path, uint64_t key, std::span<const std::filesystem::path> dependencies, std::span<const uint32_t> code)
+	{
+		std::vector<std::byte> data(sizeof(ShaderCacheHeader));
+		auto write = [&data](const void* source, uint64_t size)
+		{
+			const size_t offset = data.size();
+			data.resize(offset + size);
+			memcpy(data.data() + offset, source, size);
+		};
+
+		for (const std::filesystem::path& dependencyPath : dependencies)
+		{
+			const std::string pathString = dependencyPath.string();
+
+			ShaderCacheDependency dependency;
+			dependency.contentHash = HashFile(dependencyPath);
+			dependency.pathSize = static_cast<uint32_t>(pathString.size());
+			write(&dependency, sizeof(dependency));
+			write(pathString.data(), pathString.size());
+			data.resize(Align(data.size()));
+		}
+		write(code.data(), code.size_bytes());
+
+		ShaderCacheHeader header;
+		header.key = key;
+		header.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		header.codeSize = code.size_bytes();
+		header.codeHash = HashBytes(code.data(), code.size_bytes());
+		memcpy(data.data(), &header, sizeof(header));
+
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+		std::filesystem::path tempPath = path;
+		tempPath += ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) return false;
+			out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+			out.close();
+			if (!out)
+			{
+				std::filesystem::remove(tempPath, error);
+				return false;
+			}
+		}
+
+		std::filesystem::rename(tempPath, path, error);
+		if (error)
+		{
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+
+		return true;
+	}
+
+	static void ThrowOnFailure(SlangResult result, slang::IBlob* diagnostics, const std::string& what)
+	{
+		if (SLANG_SUCCEEDED(result)) return;
+
+		std::string message = "failed to " + what;
+		if (diagnostics) message += ":\n" + std::string(static_cast<const char*>(diagnostics->getBufferPointer()), diagnostics->getBufferSize());
+		throw std::runtime_error(message);
+	}
+
+	Slang::ComPtr<slang::IGlobalSession> AcquireGlobalSession()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			if (!m_globalSessions.empty())
+			{
+				Slang::ComPtr<slang::IGlobalSession> globalSession = m_globalSessions.back();
+				m_globalSessions.pop_back();
+				return globalSession;
+			}
+		}
+
+		Slang::ComPtr<slang::IGlobalSession> globalSession;
+		ThrowOnFailure(slang::createGlobalSession(globalSession.writeRef()), nullptr, "create Slang global session");
+		return globalSession;
+	}
+
+	void ReleaseGlobalSession(Slang::ComPtr<slang::IGlobalSession> globalSession)
+	{
+		std::lock_guard lock(m_mutex);
+		m_globalSessions.push_back(std::move(globalSession));
+	}
+
+	// Same options as the offline build: SPIR-V 1.4 emitted directly, entry points keeping their names. Also returns every file the source read.
+	static std::vector<uint32_t> CompileSpirv(slang::IGlobalSession& globalSession, const ShaderCompileRequest& request, std::string_view source, std::vector<std::filesystem::path>& dependencies)
+	{
+		std::array<slang::CompilerOptionEntry, 2> options{};
+		options[0].name = slang::CompilerOptionName::EmitSpirvDirectly;
+		options[1].name = slang::CompilerOptionName::VulkanUseEntryPointName;
+		for (slang::CompilerOptionEntry& option : options)
+		{
+			option.value.kind = slang::CompilerOptionValueKind::Int;
+			option.value.intValue0 = 1;
+		}
+
+		slang::TargetDesc target{};
+		target.format = SLANG_SPIRV;
+		target.profile = globalSession.findProfile(TARGET_PROFILE);
+		target.compilerOptionEntries = options.data();
+		target.compilerOptionEntryCount = static_cast<uint32_t>(options.size());
+
+		const std::string sourcePath = request.source.string();
+		const std::string searchPath = request.source.parent_path().string();
+		const char* searchPaths[] = { searchPath.c_str() };
+
+		std::vector<slang::PreprocessorMacroDesc> macros;
+		for (const auto& [name, value] : request.defines) macros.push_back({ name.c_str(), value.c_str() });
+
+		slang::SessionDesc sessionDesc{};
+		sessionDesc.targets = &target;
+		sessionDesc.targetCount = 1;
+		sessionDesc.searchPaths = searchPaths;
+		sessionDesc.searchPathCount = 1;
+		sessionDesc.preprocessorMacros = macros.data();
+		sessionDesc.preprocessorMacroCount = static_cast<SlangInt>(macros.size());
+
+		Slang::ComPtr<slang::ISession> session;
+		ThrowOnFailure(globalSession.createSession(sessionDesc, session.writeRef()), nullptr, "create Slang session");
+
+		// Modules belong to the session
+		Slang::ComPtr<slang::IBlob> diagnostics;
+		const std::string sourceText(source);
+		slang::IModule* module = session->loadModuleFromSourceString(request.source.stem().string().c_str(), sourcePath.c_str(), sourceText.c_str(), diagnostics.writeRef());
+		ThrowOnFailure(module ? SLANG_OK : SLANG_FAIL, diagnostics, "compile " + sourcePath);
+
+		std::vector<Slang::ComPtr<slang::IEntryPoint>> entryPoints(request.entryPoints.size());
+		std::vector<slang::IComponentType*> components{ module };
+		for (size_t i = 0; i < entryPoints.size(); i++)
+		{
+			ThrowOnFailure(module->findEntryPointByName(request.entryPoints[i].c_str(), entryPoints[i].writeRef()), nullptr, "find entry point " + request.entryPoints[i] + " in " + sourcePath);
+			components.push_back(entryPoints[i].get());
+		}
+
+		Slang::ComPtr<slang::IComponentType> program;
+		ThrowOnFailure(session->createCompositeComponentType(components.data(), static_cast<SlangInt>(components.size()), program.writeRef(), diagnostics.writeRef()), diagnostics, "compose " + request.name);
+
+		Slang::ComPtr<slang::IComponentType> linkedProgram;
+		ThrowOnFailure(program->link(linkedProgram.writeRef(), diagnostics.writeRef()), diagnostics, "link " + request.name);
+
+		Slang::ComPtr<slang::IBlob> codeBlob;
+		ThrowOnFailure(linkedProgram->getTargetCode(0, codeBlob.writeRef(), diagnostics.writeRef()), diagnostics, "generate SPIR-V for " + request.name);
+
+		for (SlangInt32 i = 0; i < module->getDependencyFileCount(); i++) dependencies.emplace_back(module->getDependencyFilePath(i));
+
+		std::vector<uint32_t> code(codeBlob->getBufferSize() / sizeof(uint32_t));
+		memcpy(code.data(), codeBlob->getBufferPointer(), code.size() * sizeof(uint32_t));
+		return code;
+	}
+
+	std::vector<uint32_t> Build(const ShaderCompileRequest& request)
+	{
+		const MappedFile sourceFile(request.source);
+		const std::string_view source(reinterpret_cast<const char*>(sourceFile.Data()), sourceFile.Size());
+		const uint64_t key = RequestKey(request, HashBytes(sourceFile.Bytes()));
+		const std::filesystem::path cachePath = GetCachePath(key);
+
+		std::vector<uint32_t> code;
+		if (LoadCached(cachePath, key, code))
+		{
+			m_cacheHits++;
+			return code;
+		}
+
+		Slang::ComPtr<slang::IGlobalSession> globalSession = AcquireGlobalSession();
+		std::vector<std::filesystem::path> dependencies;
+		code = CompileSpirv(*globalSession, request, source, dependencies);
+		ReleaseGlobalSession(std::move(globalSession));
+		m_compiles++;
+
+		// Best effort, a failed write only costs a compile next run
+		WriteCached(cachePath, key, dependencies, code);
+		return code;
+	}
+
+public:
+	explicit ShaderCompiler(std::filesystem::path cacheDirectory) : m_cacheDirectory(std::move(cacheDirectory)) {}
+
+	ShaderCompiler(const ShaderCompiler&) = delete;
+	ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+	// Builds every request in parallel over the job system and adds each to library under its name.
+	// Throws with the compiler's diagnostics when any of them fails, after the others have finished.
+	void Compile(std::span<const ShaderCompileRequest> requests, ShaderLibrary& library)
+	{
+		std::vector<std::string> errors(requests.size());
+		ParallelFor(requests.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				try
+				{
+					library.Add(requests[i].name, Build(requests[i]));
+				}
+				catch (const std::exception& e)
+				{
+					errors[i] = e.what();
+				}
+			}
+		});
+
+		for (const std::string& error : errors)
+		{
+			if (!error.empty()) throw std::runtime_error(error);
+		}
+	}
+
+	uint32_t GetCacheHitCount() const { return m_cacheHits; }
+	uint32_t GetCompileCount() const { return m_compiles; }
+};
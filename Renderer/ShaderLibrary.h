@@ -0,0 +1,250 @@
+#pragma once
+
+#include "Hash.h"
+#include "MappedFile.h"
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+
+// Shader archive: every SPIR-V module of the renderer in one file, mapped rather than read.
+//   ShaderArchiveHeader | ShaderArchiveEntry[moduleCount] | blobs
+// Entries are sorted by name hash. Modules with identical code share one blob, so the code is stored and hashed once.
+constexpr uint32_t SHADER_ARCHIVE_MAGIC = 0x41565053; // "SPVA"
+constexpr uint32_t SHADER_ARCHIVE_VERSION = 1;
+constexpr uint64_t SHADER_ARCHIVE_BLOB_ALIGNMENT = 16;
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+struct ShaderArchiveHeader
+{
+	uint32_t magic = SHADER_ARCHIVE_MAGIC;
+	uint32_t version = SHADER_ARCHIVE_VERSION;
+	uint32_t moduleCount = 0;
+	uint32_t reserved = 0;
+};
+
+struct ShaderArchiveEntry
+{
+	uint64_t nameHash = 0;
+	uint64_t codeHash = 0;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+};
+
+// Packs SPIR-V files into an archive, each one named by its file name without extension.
+// Writes next to the destination and renames over it, so a crash never leaves a torn archive behind. Returns false if nothing was written.
+inline bool WriteShaderArchive(const std::filesystem::path& path, std::span<const std::filesystem::path> modulePaths)
+{
+	auto align = [](uint64_t offset) { return (offset + SHADER_ARCHIVE_BLOB_ALIGNMENT - 1) / SHADER_ARCHIVE_BLOB_ALIGNMENT * SHADER_ARCHIVE_BLOB_ALIGNMENT; };
+
+	std::vector<ShaderArchiveEntry> entries;
+	std::vector<std::byte> blobs;
+	std::unordered_map<uint64_t, uint64_t> blobOffsets; // By code hash
+	for (const std::filesystem::path& modulePath : modulePaths)
+	{
+		const MappedFile file(modulePath);
+		if (file.Size() < sizeof(uint32_t) || file.Size() % sizeof(uint32_t) != 0) return false;
+
+		ShaderArchiveEntry entry;
+		entry.nameHash = HashString(modulePath.stem().string());
+		entry.codeHash = HashBytes(file.Bytes());
+		entry.size = file.Size();
+
+		auto [blob, inserted] = blobOffsets.try_emplace(entry.codeHash, align(blobs.size()));
+		if (inserted)
+		{
+			blobs.resize(blob->second + file.Size());
+			memcpy(blobs.data() + blob->second, file.Data(), file.Size());
+		}
+		entry.offset = blob->second;
+		entries.push_back(entry);
+	}
+	std::ranges::sort(entries, {}, &ShaderArchiveEntry::nameHash);
+
+	ShaderArchiveHeader header;
+	header.moduleCount = static_cast<uint32_t>(entries.size());
+	const uint64_t blobStart = align(sizeof(ShaderArchiveHeader) + entries.size() * sizeof(ShaderArchiveEntry));
+	for (ShaderArchiveEntry& entry : entries) entry.offset += blobStart;
+
+	std::vector<std::byte> file(blobStart + blobs.size());
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + sizeof(header), entries.data(), entries.size() * sizeof(ShaderArchiveEntry));
+	memcpy(file.data() + blobStart, blobs.data(), blobs.size());
+
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) return false;
+		out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+		out.close();
+		if (!out)
+		{
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	return true;
+}
+
+// SPIR-V modules by name, identified by the hash of their code. Opening an archive only validates its table, code stays
+// in the mapping until a module is asked for. Shader modules are created on first use, once per distinct code, and shared
+// by every pipeline using it. Callers that can pass code inline (VK_KHR_maintenance5) never create one at all.
+class ShaderLibrary
+{
+	struct Module
+	{
+		std::span<const uint32_t> code;
+		std::vector<uint32_t> ownedCode; // Modules added at runtime rather than mapped
+		std::once_flag created;
+		vk::raii::ShaderModule shaderModule = nullptr;
+	};
+
+	const vk::raii::Device* m_device = nullptr;
+	MappedFile m_archive;
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<uint64_t, uint64_t> m_names; // Name hash to code hash
+	std::unordered_map<uint64_t, std::unique_ptr<Module>> m_modules; // By code hash
+
+	Module* FindModule(uint64_t id) const
+	{
+		std::lock_guard lock(m_mutex);
+		const auto it = m_modules.find(id);
+		return it == m_modules.end() ? nullptr : it->second.get();
+	}
+
+public:
+	ShaderLibrary() = default;
+	ShaderLibrary(const ShaderLibrary&) = delete;
+	ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+	// The device has to outlive the library
+	void Init(const vk::raii::Device& device) { m_device = &device; }
+
+	// Maps an archive and registers its modules. Returns false, registering nothing, when the file is missing or malformed.
+	// Modules point into the mapping, so a library opens one archive for its whole lifetime.
+	bool Open(const std::filesystem::path& path)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			if (m_archive.Size()) throw std::runtime_error("shader library already has an archive open");
+		}
+		if (!std::filesystem::exists(path)) return false;
+
+		MappedFile archive(path);
+		const std::span<const std::byte> bytes = archive.Bytes();
+		if (bytes.size() < sizeof(ShaderArchiveHeader)) return false;
+
+		ShaderArchiveHeader header;
+		memcpy(&header, bytes.data(), sizeof(header));
+		if (header.magic != SHADER_ARCHIVE_MAGIC || header.version != SHADER_ARCHIVE_VERSION) return false;
+		if (sizeof(ShaderArchiveHeader) + uint64_t(header.moduleCount) * sizeof(ShaderArchiveEntry) > bytes.size()) return false;
+
+		const std::span<const ShaderArchiveEntry> entries{ reinterpret_cast<const ShaderArchiveEntry*>(bytes.data() + sizeof(ShaderArchiveHeader)), header.moduleCount };
+		for (const ShaderArchiveEntry& entry : entries)
+		{
+			// Mappings are page aligned, so aligned offsets give code that can be read as words in place
+			if (entry.offset % SHADER_ARCHIVE_BLOB_ALIGNMENT != 0 || entry.size < sizeof(uint32_t) || entry.size % sizeof(uint32_t) != 0) return false;
+			if (entry.offset > bytes.size() || entry.size > bytes.size() - entry.offset) return false;
+
+			uint32_t magic = 0;
+			memcpy(&magic, bytes.data() + entry.offset, sizeof(magic));
+			if (magic != SPIRV_MAGIC) return false;
+		}
+
+		std::lock_guard lock(m_mutex);
+		for (const ShaderArchiveEntry& entry : entries)
+		{
+			m_names[entry.nameHash] = entry.codeHash;
+
+			std::unique_ptr<Module>& module = m_modules[entry.codeHash];
+			if (module) continue;
+			module = std::make_unique<Module>();
+			module->code = { reinterpret_cast<const uint32_t*>(bytes.data() + entry.offset), entry.size / sizeof(uint32_t) };
+		}
+		m_archive = std::move(archive);
+
+		return true;
+	}
+
+	// Registers code built at runtime under name, replacing what the name pointed at. Returns its id.
+	uint64_t Add(std::string_view name, std::vector<uint32_t> code)
+	{
+		const uint64_t id = HashBytes(code.data(), code.size() * sizeof(uint32_t));
+
+		std::lock_guard lock(m_mutex);
+		m_names[HashString(name)] = id;
+
+		std::unique_ptr<Module>& module = m_modules[id];
+		if (!module)
+		{
+			module = std::make_unique<Module>();
+			module->ownedCode = std::move(code);
+			module->code = module->ownedCode;
+		}
+
+		return id;
+	}
+
+	// The id of a module, its code hash, or 0 when there is no module by that name
+	uint64_t Find(std::string_view name) const
+	{
+		std::lock_guard lock(m_mutex);
+		const auto it = m_names.find(HashString(name));
+		return it == m_names.end() ? 0 : it->second;
+	}
+
+	// Empty for unknown ids. Stays valid for the library's lifetime.
+	std::span<const uint32_t> GetCode(uint64_t id) const
+	{
+		const Module* module = FindModule(id);
+		return module ? module->code : std::span<const uint32_t>{};
+	}
+
+	// Created on the first call for an id, from any thread. Null for unknown ids.
+	vk::ShaderModule GetShaderModule(uint64_t id)
+	{
+		Module* module = FindModule(id);
+		if (!module) return nullptr;
+
+		std::call_once(module->created, [&]()
+		{
+			vk::ShaderModuleCreateInfo createInfo{};
+			createInfo.codeSize = module->code.size_bytes();
+			createInfo.pCode = module->code.data();
+			module->shaderModule = vk::raii::ShaderModule{ *m_device, createInfo };
+		});
+
+		return *module->shaderModule;
+	}
+
+	size_t GetModuleCount() const
+	{
+		std::lock_guard lock(m_mutex);
+		return m_names.size();
+	}
+};
@@ -0,0 +1,433 @@
+#pragma once
+
+#include "ShaderLibrary.h"
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+// What a SPIR-V module asks of its pipeline layout and vertex input, read straight from the code so it works the same for
+// modules compiled at runtime, loaded from the compiler's cache or packed offline.
+struct ReflectedBinding
+{
+	uint32_t set = 0;
+	uint32_t binding = 0;
+	vk::DescriptorType type = vk::DescriptorType::eSampler;
+	uint32_t count = 1; // 0 for runtime sized arrays
+	vk::ShaderStageFlags stages;
+};
+
+struct ReflectedVertexInput
+{
+	uint32_t location = 0;
+	vk::Format format = vk::Format::eUndefined;
+};
+
+struct ReflectedEntryPoint
+{
+	std::string name;
+	vk::ShaderStageFlagBits stage = vk::ShaderStageFlagBits::eVertex;
+	std::vector<ReflectedVertexInput> vertexInputs; // Vertex entry points only, by location
+};
+
+// Bindings are the union over every entry point, so all pipelines built from one module share one layout.
+// Push constants of all entry points are folded into one range carrying the stages that use them.
+struct ShaderReflection
+{
+	std::vector<ReflectedBinding> bindings; // By set, then binding
+	std::vector<vk::PushConstantRange> pushConstantRanges;
+	std::vector<ReflectedEntryPoint> entryPoints;
+
+	const ReflectedEntryPoint* FindEntryPoint(std::string_view name) const
+	{
+		const auto it = std::ranges::find(entryPoints, name, &ReflectedEntryPoint::name);
+		return it == entryPoints.end() ? nullptr : &*it;
+	}
+};
+
+// Byte size of the formats reflection produces for vertex inputs
+inline uint32_t VertexFormatSize(vk::Format format)
+{
+	switch (format)
+	{
+	case vk::Format::eR32Sfloat: case vk::Format::eR32Sint: case vk::Format::eR32Uint: return 4;
+	case vk::Format::eR32G32Sfloat: case vk::Format::eR32G32Sint: case vk::Format::eR32G32Uint: return 8;
+	case vk::Format::eR32G32B32Sfloat: case vk::Format::eR32G32B32Sint: case vk::Format::eR32G32B32Uint: return 12;
+	case vk::Format::eR32G32B32A32Sfloat: case vk::Format::eR32G32B32A32Sint: case vk::Format::eR32G32B32A32Uint: return 16;
+	default: return 0;
+	}
+}
+
+// Parses only the declarations: entry points, types, decorations and global variables. In SPIR-V 1.4 and later an entry point
+// lists every global it touches, which is what tells the stages of a binding apart. Returns false on malformed code.
+inline bool ReflectSpirv(std::span<const uint32_t> code, ShaderReflection& reflection)
+{
+	enum : uint32_t
+	{
+		OP_ENTRY_POINT = 15,
+		OP_TYPE_INT = 21,
+		OP_TYPE_FLOAT = 22,
+		OP_TYPE_VECTOR = 23,
+		OP_TYPE_MATRIX = 24,
+		OP_TYPE_IMAGE = 25,
+		OP_TYPE_SAMPLER = 26,
+		OP_TYPE_SAMPLED_IMAGE = 27,
+		OP_TYPE_ARRAY = 28,
+		OP_TYPE_RUNTIME_ARRAY = 29,
+		OP_TYPE_STRUCT = 30,
+		OP_TYPE_POINTER = 32,
+		OP_CONSTANT = 43,
+		OP_VARIABLE = 59,
+		OP_DECORATE = 71,
+		OP_MEMBER_DECORATE = 72,
+		OP_TYPE_ACCELERATION_STRUCTURE = 5341,
+
+		DECORATION_BLOCK = 2,
+		DECORATION_BUFFER_BLOCK = 3,
+		DECORATION_ARRAY_STRIDE = 6,
+		DECORATION_MATRIX_STRIDE = 7,
+		DECORATION_BUILT_IN = 11,
+		DECORATION_LOCATION = 30,
+		DECORATION_BINDING = 33,
+		DECORATION_DESCRIPTOR_SET = 34,
+		DECORATION_OFFSET = 35,
+
+		STORAGE_UNIFORM_CONSTANT = 0,
+		STORAGE_INPUT = 1,
+		STORAGE_UNIFORM = 2,
+		STORAGE_PUSH_CONSTANT = 9,
+		STORAGE_STORAGE_BUFFER = 12,
+
+		DIM_BUFFER = 5,
+		DIM_SUBPASS_DATA = 6,
+
+		NONE = ~0u
+	};
+
+	struct Id
+	{
+		uint32_t opcode = 0;
+		std::vector<uint32_t> operands; // Types: everything after the result id. Constants and variables: every word.
+		uint32_t set = NONE;
+		uint32_t binding = NONE;
+		uint32_t location = NONE;
+		uint32_t arrayStride = 0;
+		bool block = false;
+		bool bufferBlock = false;
+		bool builtIn = false;
+		std::vector<uint32_t> memberOffsets;
+		std::vector<uint32_t> memberMatrixStrides;
+	};
+
+	struct EntryPoint
+	{
+		vk::ShaderStageFlagBits stage;
+		std::string name;
+		std::vector<uint32_t> interface;
+	};
+
+	if (code.size() < 5 || code[0] != SPIRV_MAGIC) return false;
+
+	const uint32_t bound = code[3];
+	std::vector<Id> ids(bound);
+	std::vector<EntryPoint> entryPoints;
+	std::vector<uint32_t> variables;
+
+	auto memberSlot = [](std::vector<uint32_t>& values, uint32_t member) -> uint32_t&
+	{
+		if (member >= values.size()) values.resize(member + 1, 0);
+		return values[member];
+	};
+
+	for (size_t offset = 5; offset < code.size();)
+	{
+		const uint32_t wordCount = code[offset] >> 16;
+		const uint32_t opcode = code[offset] & 0xFFFF;
+		if (wordCount == 0 || offset + wordCount > code.size()) return false;
+		const std::span<const uint32_t> words = code.subspan(offset + 1, wordCount - 1);
+		offset += wordCount;
+
+		switch (opcode)
+		{
+		case OP_ENTRY_POINT:
+		{
+			if (words.size() < 3) return false;
+
+			EntryPoint& entryPoint = entryPoints.emplace_back();
+			switch (words[0])
+			{
+			case 0: entryPoint.stage = vk::ShaderStageFlagBits::eVertex; break;
+			case 1: entryPoint.stage = vk::ShaderStageFlagBits::eTessellationControl; break;
+			case 2: entryPoint.stage = vk::ShaderStageFlagBits::eTessellationEvaluation; break;
+			case 3: entryPoint.stage = vk::ShaderStageFlagBits::eGeometry; break;
+			case 4: entryPoint.stage = vk::ShaderStageFlagBits::eFragment; break;
+			case 5: entryPoint.stage = vk::ShaderStageFlagBits::eCompute; break;
+			case 5364: entryPoint.stage = vk::ShaderStageFlagBits::eTaskEXT; break;
+			case 5365: entryPoint.stage = vk::ShaderStageFlagBits::eMeshEXT; break;
+			default: return false;
+			}
+
+			// The name is a nul terminated string packed into words
+			const char* name = reinterpret_cast<const char*>(&words[2]);
+			const size_t nameLength = strnlen(name, (words.size() - 2) * sizeof(uint32_t));
+			entryPoint.name.assign(name, nameLength);
+			const size_t interfaceStart = 2 + nameLength / sizeof(uint32_t) + 1;
+			if (interfaceStart > words.size()) return false;
+			entryPoint.interface.assign(words.begin() + interfaceStart, words.end());
+			break;
+		}
+		case OP_DECORATE:
+		{
+			if (words.size() < 2 || words[0] >= bound) return false;
+
+			Id& target = ids[words[0]];
+			const uint32_t value = words.size() > 2 ? words[2] : 0;
+			switch (words[1])
+			{
+			case DECORATION_BLOCK: target.block = true; break;
+			case DECORATION_BUFFER_BLOCK: target.bufferBlock = true; break;
+			case DECORATION_ARRAY_STRIDE: target.arrayStride = value; break;
+			case DECORATION_BUILT_IN: target.builtIn = true; break;
+			case DECORATION_LOCATION: target.location = value; break;
+			case DECORATION_BINDING: target.binding = value; break;
+			case DECORATION_DESCRIPTOR_SET: target.set = value; break;
+			default: break;
+			}
+			break;
+		}
+		case OP_MEMBER_DECORATE:
+		{
+			if (words.size() < 4 || words[0] >= bound) return false;
+
+			Id& target = ids[words[0]];
+			if (words[2] == DECORATION_OFFSET) memberSlot(target.memberOffsets, words[1]) = words[3];
+			if (words[2] == DECORATION_MATRIX_STRIDE) memberSlot(target.memberMatrixStrides, words[1]) = words[3];
+			break;
+		}
+		case OP_TYPE_INT:
+		case OP_TYPE_FLOAT:
+		case OP_TYPE_VECTOR:
+		case OP_TYPE_MATRIX:
+		case OP_TYPE_IMAGE:
+		case OP_TYPE_SAMPLER:
+		case OP_TYPE_SAMPLED_IMAGE:
+		case OP_TYPE_ARRAY:
+		case OP_TYPE_RUNTIME_ARRAY:
+		case OP_TYPE_STRUCT:
+		case OP_TYPE_POINTER:
+		case OP_TYPE_ACCELERATION_STRUCTURE:
+		{
+			if (words.empty() || words[0] >= bound) return false;
+			ids[words[0]].opcode = opcode;
+			ids[words[0]].operands.assign(words.begin() + 1, words.end());
+			break;
+		}
+		case OP_CONSTANT:
+		case OP_VARIABLE:
+		{
+			// Result type comes first here, the operands keep it
+			if (words.size() < 2 || words[1] >= bound) return false;
+			ids[words[1]].opcode = opcode;
+			ids[words[1]].operands.assign(words.begin(), words.end());
+			if (opcode == OP_VARIABLE) variables.push_back(words[1]);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	auto get = [&](uint32_t id) -> const Id* { return id < bound && ids[id].opcode ? &ids[id] : nullptr; };
+
+	// Sizes as laid out by the explicit offset and stride decorations buffers carry
+	auto typeSize = [&](auto& self, uint32_t typeId, uint32_t matrixStride) -> uint32_t
+	{
+		const Id* type = get(typeId);
+		if (!type) return 0;
+		switch (type->opcode)
+		{
+		case OP_TYPE_INT:
+		case OP_TYPE_FLOAT:
+			return type->operands.empty() ? 0 : type->operands[0] / 8;
+		case OP_TYPE_VECTOR:
+			return type->operands.size() < 2 ? 0 : self(self, type->operands[0], 0) * type->operands[1];
+		case OP_TYPE_MATRIX:
+			if (type->operands.size() < 2) return 0;
+			return matrixStride ? matrixStride * type->operands[1] : self(self, type->operands[0], 0) * type->operands[1];
+		case OP_TYPE_ARRAY:
+		{
+			if (type->operands.size() < 2) return 0;
+			const Id* length = get(type->operands[1]);
+			const uint32_t count = length && length->opcode == OP_CONSTANT && length->operands.size() > 2 ? length->operands[2] : 0;
+			return count * (type->arrayStride ? type->arrayStride : self(self, type->operands[0], 0));
+		}
+		case OP_TYPE_STRUCT:
+		{
+			uint32_t size = 0;
+			for (uint32_t member = 0; member < type->operands.size(); member++)
+			{
+				const uint32_t memberOffset = member < type->memberOffsets.size() ? type->memberOffsets[member] : 0;
+				const uint32_t memberStride = member < type->memberMatrixStrides.size() ? type->memberMatrixStrides[member] : 0;
+				size = std::max(size, memberOffset + self(self, type->operands[member], memberStride));
+			}
+			return size;
+		}
+		default:
+			return 0;
+		}
+	};
+
+	auto vertexFormat = [&](uint32_t typeId) -> vk::Format
+	{
+		const Id* type = get(typeId);
+		if (!type) return vk::Format::eUndefined;
+
+		uint32_t components = 1;
+		if (type->opcode == OP_TYPE_VECTOR && type->operands.size() >= 2)
+		{
+			components = type->operands[1];
+			type = get(type->operands[0]);
+			if (!type) return vk::Format::eUndefined;
+		}
+		if (type->operands.empty() || type->operands[0] != 32 || components < 1 || components > 4) return vk::Format::eUndefined;
+
+		static constexpr vk::Format FLOAT_FORMATS[] = { vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat };
+		static constexpr vk::Format SINT_FORMATS[] = { vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint };
+		static constexpr vk::Format UINT_FORMATS[] = { vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint };
+		if (type->opcode == OP_TYPE_FLOAT) return FLOAT_FORMATS[components - 1];
+		if (type->opcode == OP_TYPE_INT) return type->operands.size() > 1 && type->operands[1] ? SINT_FORMATS[components - 1] : UINT_FORMATS[components - 1];
+		return vk::Format::eUndefined;
+	};
+
+	// Descriptor type and array size of a resource variable's pointee, false for anything that isn't a descriptor
+	auto descriptor = [&](uint32_t storageClass, uint32_t typeId, vk::DescriptorType& descriptorType, uint32_t& count) -> bool
+	{
+		count = 1;
+		const Id* type = get(typeId);
+		if (type && (type->opcode == OP_TYPE_ARRAY || type->opcode == OP_TYPE_RUNTIME_ARRAY) && !type->operands.empty())
+		{
+			count = 0;
+			if (type->opcode == OP_TYPE_ARRAY && type->operands.size() > 1)
+			{
+				const Id* length = get(type->operands[1]);
+				if (!length || length->opcode != OP_CONSTANT || length->operands.size() < 3) return false;
+				count = length->operands[2];
+			}
+			type = get(type->operands[0]);
+		}
+		if (!type) return false;
+
+		switch (type->opcode)
+		{
+		case OP_TYPE_STRUCT:
+			if (storageClass == STORAGE_STORAGE_BUFFER || type->bufferBlock) descriptorType = vk::DescriptorType::eStorageBuffer;
+			else if (storageClass == STORAGE_UNIFORM && type->block) descriptorType = vk::DescriptorType::eUniformBuffer;
+			else return false;
+			return true;
+		case OP_TYPE_SAMPLER:
+			descriptorType = vk::DescriptorType::eSampler;
+			return true;
+		case OP_TYPE_SAMPLED_IMAGE:
+			descriptorType = vk::DescriptorType::eCombinedImageSampler;
+			return true;
+		case OP_TYPE_ACCELERATION_STRUCTURE:
+			descriptorType = vk::DescriptorType::eAccelerationStructureKHR;
+			return true;
+		case OP_TYPE_IMAGE:
+		{
+			if (type->operands.size() < 6) return false;
+			const uint32_t dim = type->operands[1];
+			const bool storage = type->operands[5] == 2;
+			if (dim == DIM_SUBPASS_DATA) descriptorType = vk::DescriptorType::eInputAttachment;
+			else if (dim == DIM_BUFFER) descriptorType = storage ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+			else descriptorType = storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+			return true;
+		}
+		default:
+			return false;
+		}
+	};
+
+	std::unordered_map<uint32_t, vk::ShaderStageFlags> variableStages;
+	for (const EntryPoint& entryPoint : entryPoints)
+	{
+		for (uint32_t variable : entryPoint.interface) variableStages[variable] |= entryPoint.stage;
+	}
+
+	reflection = {};
+	uint32_t pushConstantBegin = NONE;
+	uint32_t pushConstantEnd = 0;
+	vk::ShaderStageFlags pushConstantStages;
+	for (uint32_t variableId : variables)
+	{
+		const Id& variable = ids[variableId];
+		const auto stages = variableStages.find(variableId);
+		if (stages == variableStages.end()) continue;
+
+		const Id* pointer = get(variable.operands[0]);
+		if (!pointer || pointer->opcode != OP_TYPE_POINTER || pointer->operands.size() < 2) return false;
+		const uint32_t storageClass = pointer->operands[0];
+		const uint32_t pointeeId = pointer->operands[1];
+
+		if (storageClass == STORAGE_PUSH_CONSTANT)
+		{
+			const Id* block = get(pointeeId);
+			if (!block || block->opcode != OP_TYPE_STRUCT) return false;
+
+			const uint32_t begin = block->memberOffsets.empty() ? 0 : std::ranges::min(block->memberOffsets);
+			pushConstantBegin = std::min(pushConstantBegin, begin);
+			pushConstantEnd = std::max(pushConstantEnd, typeSize(typeSize, pointeeId, 0));
+			pushConstantStages |= stages->second;
+		}
+		else if (storageClass == STORAGE_UNIFORM_CONSTANT || storageClass == STORAGE_UNIFORM || storageClass == STORAGE_STORAGE_BUFFER)
+		{
+			ReflectedBinding binding;
+			if (!descriptor(storageClass, pointeeId, binding.type, binding.count)) continue;
+			if (variable.binding == NONE) return false;
+
+			binding.set = variable.set == NONE ? 0 : variable.set;
+			binding.binding = variable.binding;
+			binding.stages = stages->second;
+			reflection.bindings.push_back(binding);
+		}
+	}
+
+	if (pushConstantEnd > 0)
+	{
+		const uint32_t begin = pushConstantBegin & ~3u;
+		reflection.pushConstantRanges.push_back({ pushConstantStages, begin, (pushConstantEnd - begin + 3) & ~3u });
+	}
+
+	std::ranges::sort(reflection.bindings, [](const ReflectedBinding& a, const ReflectedBinding& b) { return a.set != b.set ? a.set < b.set : a.binding < b.binding; });
+
+	for (const EntryPoint& entryPoint : entryPoints)
+	{
+		ReflectedEntryPoint& reflected = reflection.entryPoints.emplace_back();
+		reflected.name = entryPoint.name;
+		reflected.stage = entryPoint.stage;
+		if (entryPoint.stage != vk::ShaderStageFlagBits::eVertex) continue;
+
+		for (uint32_t variableId : entryPoint.interface)
+		{
+			const Id* variable = get(variableId);
+			if (!variable || variable->opcode != OP_VARIABLE || variable->builtIn || variable->location == NONE) continue;
+
+			const Id* pointer = get(variable->operands[0]);
+			if (!pointer || pointer->operands.size() < 2 || pointer->operands[0] != STORAGE_INPUT) continue;
+
+			const vk::Format format = vertexFormat(pointer->operands[1]);
+			if (format == vk::Format::eUndefined) return false;
+			reflected.vertexInputs.push_back({ variable->location, format });
+		}
+		std::ranges::sort(reflected.vertexInputs, {}, &ReflectedVertexInput::location);
+	}
+
+	return true;
+}
@@ -19,8 +19,33 @@ import vulkan_hpp;
 #include <memory>
 #include <iostream>
 #include <cstdlib>
+#include <cstddef>
 #include <fstream>
 #include <chrono>
+#include <charconv>
+#include <unordered_map>
+#include <filesystem>
+#include <bit>
+
+#include "GeometryPool.h"
+#include "MeshLod.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include "Hash.h"
+#include "JobSystem.h"
+#include "Parallel.h"
+#include "SceneGraph.h"
+#include "Culling.h"
+#include "Bvh.h"
+#include "RenderQueue.h"
+#include "PipelineCache.h"
+#include "PipelineBinaryArchive.h"
+#include "PipelineRegistry.h"
+#include "ShaderLibrary.h"
+#include "ShaderCompiler.h"
+#include "ShaderReflection.h"
+#include "LayoutCache.h"
+#include "DescriptorWriter.h"
 
 using namespace std;
 using namespace vk;
@@ -32,23 +57,106 @@ struct Vertex
 	glm::vec2 UV;
 
 	static VertexInputBindingDescription getBindingDescription() { return { 0, sizeof(Vertex), VertexInputRate::eVertex }; }
-	static array<VertexInputAttributeDescription, 3> getAttributeDescriptions()
+};
+
+// Where a vertex's attributes sit, in bytes, so vertex pulling decodes vertices from data instead of assuming Vertex.
+// Matches VertexFormat in Shader.slang. Attributes are 32 bit floats and their offsets multiples of 4.
+struct VertexFormat
+{
+	uint32_t stride;
+	uint32_t positionOffset;
+	uint32_t colorOffset;
+	uint32_t uvOffset;
+};
+
+constexpr VertexFormat VERTEX_FORMAT{ sizeof(Vertex), offsetof(Vertex, pos), offsetof(Vertex, col), offsetof(Vertex, UV) };
+
+// Per draw data, matches DrawPC in Shader.slang. vertexBase and vertexFormat are only read by the vertex pulling path.
+struct DrawPC
+{
+	uint32_t vertexBase;
+	uint32_t instanceBase;
+	VertexFormat vertexFormat;
+};
+
+enum InstanceFlag : uint32_t
+{
+	INSTANCE_FLAG_HIGHLIGHTED = 1 << 0 // The picked object
+};
+
+// One entry of the instance buffer, matches InstanceData in Shader.slang. mesh and permutationSlot are only read by GPU culling.
+// World matrices are affine, so only their top three rows are sent, which keeps an entry at 64 bytes.
+struct InstanceData
+{
+	glm::vec4 worldRows[3];
+	uint32_t material;
+	uint32_t mesh;
+	uint32_t permutationSlot; // Of the material's shader permutation
+	uint32_t flags; // InstanceFlag bits
+
+	static InstanceData Make(const glm::mat4& world, uint32_t material, uint32_t mesh, uint32_t permutationSlot, uint32_t flags)
 	{
-		return
-		{
-			VertexInputAttributeDescription(0, 0, Format::eR32G32B32Sfloat, offsetof(Vertex, pos)),
-			VertexInputAttributeDescription(1, 0, Format::eR32G32B32Sfloat, offsetof(Vertex, col)),
-			VertexInputAttributeDescription(2, 0, Format::eR32G32Sfloat, offsetof(Vertex, UV))
-		};
+		const glm::mat4 rows = glm::transpose(world);
+		return { { rows[0], rows[1], rows[2] }, material, mesh, permutationSlot, flags };
 	}
 };
+static_assert(sizeof(InstanceData) == 64);
+
+// Per mesh data for GPU culling, uploaded once. Matches GpuMesh in Shader.slang.
+constexpr uint32_t MAX_GPU_LODS = 8;
+
+struct GpuMeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;
+	uint32_t padding;
+};
+
+struct GpuMesh
+{
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t lodCount;
+	uint32_t indexSlot;
+	GpuMeshLod lods[MAX_GPU_LODS];
+};
 
-struct MatrixUB
+// Matches CullPC in Shader.slang. The frustum planes are extracted from viewProj in the shader, which also uses it to
+// project bounds onto the depth pyramid. pyramidLevelCount 0 turns the occlusion test off. permutationCount is the number
+// of shader permutation slots the draw lists were made for. LODs are picked like SelectLod, lodHysteresis included.
+struct CullPC
+{
+	glm::mat4 viewProj;
+	glm::vec3 cameraPosition;
+	float pixelsPerWorldUnit;
+	uint32_t objectCount;
+	uint32_t drawCapacity;
+	float lodThresholdPixels;
+	uint32_t phase;
+	glm::vec2 depthSize;
+	uint32_t pyramidLevelCount;
+	uint32_t permutationCount;
+	float lodHysteresis;
+	uint32_t padding[3];
+};
+
+// Matches PyramidPC in Shader.slang
+struct PyramidPC
+{
+	glm::uvec2 sourceSize;
+	glm::uvec2 destinationSize;
+};
+
+// Per view data, written once per frame. Matches ViewUB in Shader.slang, camera is the position with w unused.
+struct ViewUB
 {
-	glm::mat4 world;
 	glm::mat4 view;
 	glm::mat4 proj;
-	glm::mat4 WVP;
+	glm::mat4 viewProj;
+	glm::vec4 camera;
 };
 
 const vector<Vertex> vertices =
@@ -72,8 +180,117 @@ const vector<uint16_t> indices =
 	6, 7, 4
 };
 
+struct Mesh
+{
+	MeshRange range;
+	VertexFormat vertexFormat = VERTEX_FORMAT; // The geometry pool is allocated in Vertex sized slots, so the stride is always that of Vertex
+	vector<MeshLod> lods;
+	glm::vec3 boundsCenter{ 0.0f };
+	float boundsRadius = 0.0f;
+};
+
+// Output of the importer and simplifier, in exactly the layout that gets uploaded and cached
+struct CookedMesh
+{
+	vector<Vertex> vertices;
+	vector<byte> indices; // Packed at indexSize bytes per index
+	uint32_t indexSize = 2;
+	vector<MeshLod> lods;
+	glm::vec3 boundsCenter{ 0.0f };
+	float boundsRadius = 0.0f;
+};
+
+struct RenderObject
+{
+	uint32_t mesh = 0;
+	uint32_t lod = 0;
+	SceneNode node = INVALID_SCENE_NODE;
+	uint32_t material = 0;
+	DrawPass pass = DrawPass::Opaque;
+};
+
+// One record of the material buffer, matches MaterialData in Shader.slang. Texture and sampler index the bindless arrays.
+struct MaterialData
+{
+	glm::vec4 baseColorFactor{ 1.0f };
+	uint32_t baseColorTexture = 0;
+	uint32_t sampler = 0;
+	uint32_t normalTexture = 0; // Only read with SHADER_FEATURE_NORMAL_MAPPING
+	float alphaCutoff = 0.5f; // Only read with SHADER_FEATURE_ALPHA_TEST
+};
+
+// Fragment shader permutations, the specialization constants of Shader.slang. A permutation key is the feature bits with
+// the lighting model above them, and every material has one.
+enum ShaderFeature : uint32_t
+{
+	SHADER_FEATURE_ALPHA_TEST = 1 << 0,
+	SHADER_FEATURE_NORMAL_MAPPING = 1 << 1, // Lit permutations only
+	SHADER_FEATURE_VERTEX_COLOR = 1 << 2
+};
+
+enum LightingModel : uint32_t
+{
+	LIGHTING_MODEL_UNLIT,
+	LIGHTING_MODEL_LAMBERT
+};
+
+constexpr uint32_t SHADER_FEATURE_BITS = 8;
+
+constexpr uint32_t MakeShaderPermutation(uint32_t features, LightingModel lightingModel) { return features | (lightingModel << SHADER_FEATURE_BITS); }
+
+// Constant ids are the indices below, as declared in Shader.slang
+void ApplyShaderPermutation(GraphicsPipelineDesc& desc, uint32_t permutation)
+{
+	desc.specialization[0] = (permutation & SHADER_FEATURE_ALPHA_TEST) ? 1 : 0;
+	desc.specialization[1] = (permutation & SHADER_FEATURE_NORMAL_MAPPING) ? 1 : 0;
+	desc.specialization[2] = (permutation & SHADER_FEATURE_VERTEX_COLOR) ? 1 : 0;
+	desc.specialization[3] = permutation >> SHADER_FEATURE_BITS;
+}
+
+// Graphics pipelines a draw can ask for. The pipeline field of its sort key is one of these plus DRAW_PIPELINE_COUNT times
+// the slot of its material's shader permutation, see DrawPipelineId.
+enum DrawPipeline : uint32_t
+{
+	DRAW_PIPELINE_VERTEX_INPUT,
+	DRAW_PIPELINE_PULLED,
+	DRAW_PIPELINE_INDIRECT,
+	DRAW_PIPELINE_COUNT
+};
+
+constexpr uint32_t DrawPipelineId(uint32_t pipeline, uint32_t permutationSlot) { return permutationSlot * DRAW_PIPELINE_COUNT + pipeline; }
+
+// Visible objects sharing all draw state, drawn with one instanced drawIndexed. Instances are a range of the instance buffer.
+struct DrawBatch
+{
+	uint32_t pipeline = DRAW_PIPELINE_VERTEX_INPUT;
+	uint32_t material = 0;
+	uint32_t mesh = 0;
+	uint32_t lod = 0;
+	uint32_t firstInstance = 0;
+	uint32_t instanceCount = 0;
+};
+
+// Secondary command buffers owned by one thread for one frame in flight. Reset as a whole once that frame's fence has signaled.
+struct RecordingPool
+{
+	raii::CommandPool pool = nullptr;
+	vector<raii::CommandBuffer> buffers;
+	uint32_t used = 0;
+};
+
+// Switches for a normal run, --benchmark-culling and --benchmark-scene run a benchmark instead
+struct RendererOptions
+{
+	bool verbose = false; // --verbose, prints startup and exit statistics
+	PipelineBackend pipelineBackend = PipelineBackend::Library; // --pipeline-backend monolithic|library|shader-object
+	bool vertexPulling = true; // --vertex-input turns it off, CPU culled draws then use fixed-function vertex input
+	bool occlusionCulling = true; // --no-occlusion turns it off, the GPU driven path then culls against the frustum only
+};
+
 class HelloTriangleApplication
 {
+	bool m_verbose = false;
+
 	int m_width = 800;
 	int m_height = 600;
 	const int MAX_FRAMES_IN_FLIGHT = 2;
@@ -103,6 +320,17 @@ class HelloTriangleApplication
 		KHRCreateRenderpass2ExtensionName
 	};
 
+	// Optional, lets tiny meshes use 8 bit indices
+	bool m_indexTypeUint8Supported = false;
+
+	// Needed by the GPU driven path, which falls back to CPU culling without them.
+	// Its indirect draws carry the object index in firstInstance.
+	bool m_drawIndirectCountSupported = false;
+	bool m_drawIndirectFirstInstanceSupported = false;
+
+	// Optional, pyramid levels push their two descriptors per dispatch instead of keeping a set each
+	bool m_pushDescriptorSupported = false;
+
 	raii::Queue m_queue = nullptr;
 	uint32_t m_queueIndex = ~0;
 
@@ -112,26 +340,185 @@ class HelloTriangleApplication
 	Extent2D m_swapChainExtent{};
 	vector<raii::ImageView> m_swapChainImageViews;
 
-	raii::DescriptorSetLayout m_descriptorSetLayout = nullptr;
+	// Set and pipeline layouts come from reflecting the shader modules, one of each per distinct signature.
+	// Descriptor updates are staged in the writer and applied in batches, through an update template per set layout.
+	// The handles below belong to the cache and the writer.
+	LayoutCache m_layoutCache;
+	DescriptorWriter m_descriptorWriter;
+	DescriptorSetLayout m_descriptorSetLayout = nullptr;
+	DescriptorUpdateTemplate m_descriptorTemplate = nullptr;
+	vector<ReflectedVertexInput> m_vertexInputs; // Of vertMain, by location
 
 	raii::RenderPass m_renderPass = nullptr;
 
-	raii::PipelineLayout m_pipelineLayout = nullptr;
-	raii::Pipeline m_graphicsPipeline = nullptr;
+	// Loaded at startup when it was written by this device and driver, saved on exit and every so often while running
+	raii::PipelineCache m_pipelineCache = nullptr;
+	PipelineCacheHeader m_pipelineCacheIdentity{};
+	bool m_pipelineCacheWarm = false;
+	uint64_t m_pipelineCacheSavedHash = 0;
+	chrono::steady_clock::time_point m_pipelineCacheSavedTime{};
+	const string PIPELINE_CACHE_PATH = "Cache/Pipeline/pipelines.bin";
+	static constexpr chrono::seconds PIPELINE_CACHE_SAVE_INTERVAL{ 60 };
+
+	// VK_KHR_pipeline_binary where the device has it and doesn't prefer its own cache: draw pipelines are created straight from
+	// the binaries captured on an earlier run, nothing compiles. Saved along with the pipeline cache.
+	bool m_pipelineBinariesEnabled = false;
+	PipelineBinaryArchive m_pipelineBinaryArchive;
+	const string PIPELINE_BINARY_ARCHIVE_PATH = "Cache/Pipeline/binaries.bin";
+
+	// Every SPIR-V module in one mapped archive, repacked from the compiled .spv files whenever one of them is newer.
+	// Where the Slang source is present the modules are rebuilt from it at startup, through the compiler's cache.
+	// With VK_KHR_maintenance5 pipelines take the code inline and the library never creates a shader module for them.
+	ShaderLibrary m_shaderLibrary;
+	bool m_maintenance5Supported = false;
+	uint64_t m_drawShader = 0;
+	uint64_t m_cullShader = 0;
+	uint64_t m_pyramidShader = 0;
+	const string SHADER_DIRECTORY = "Shader";
+	const string SHADER_SOURCE_PATH = "Shader/Shader.slang";
+	const string SHADER_ARCHIVE_PATH = "Cache/Shader/shaders.bin";
+	const string SHADER_CACHE_DIRECTORY = "Cache/Shader/Compiled";
+
+	PipelineLayout m_pipelineLayout = nullptr;
+
+	// Draw pipelines compile on the registry's threads, overlapping asset loading. Until one is ready its draws are skipped,
+	// or the pulled ones fall back to vertex input, which shades the same. Resolved once per frame so every list sees the same set.
+	PipelineRegistry m_pipelineRegistry;
+	PipelineBackend m_pipelineBackend = PipelineBackend::Library; // As asked for on the command line, steps down to what the device supports
+	array<GraphicsPipelineDesc, DRAW_PIPELINE_COUNT> m_drawPipelineDescs{};
+	vector<GraphicsPipelineHandle> m_drawPipelines; // By draw pipeline id
+
+	// Permutation keys in use, each material points at one. Slot 0 is the default permutation.
+	static constexpr uint32_t DEFAULT_SHADER_PERMUTATION = MakeShaderPermutation(0, LIGHTING_MODEL_UNLIT);
+	static constexpr uint32_t MAX_SHADER_PERMUTATIONS = (1 << DrawKey::PIPELINE_BITS) / DRAW_PIPELINE_COUNT;
+	vector<uint32_t> m_shaderPermutations{ DEFAULT_SHADER_PERMUTATION };
+	vector<uint32_t> m_materialPermutationSlots;
+	atomic<uint64_t> m_drawsSkippedNotReady{ 0 };
+
+	// Same shading, but vertices are read from the geometry pool as a storage buffer and the pipeline has no vertex input state
+	bool m_vertexPulling = true; // Unless --vertex-input
+
+	// GPU driven mode: a compute pass culls every object and picks its LOD, writing compacted indirect draws and their counts.
+	// Commands are grouped by shader permutation and index width, so drawing takes one drawIndexedIndirectCount per pair in use.
+	bool m_gpuDriven = true;
+	DescriptorSetLayout m_cullDescriptorSetLayout = nullptr;
+	DescriptorUpdateTemplate m_cullDescriptorTemplate = nullptr;
+	PipelineLayout m_cullPipelineLayout = nullptr;
+	raii::Pipeline m_cullPipeline = nullptr;
+	raii::DescriptorPool m_cullDescriptorPool = nullptr;
+	vector<raii::DescriptorSet> m_cullDescriptorSets;
+	static constexpr uint32_t CULL_GROUP_SIZE = 64;
+	static constexpr uint32_t INDEX_SLOT_COUNT = 3; // 8, 16 and 32 bit indices
+	static constexpr uint32_t CULL_PHASE_COUNT = 2;
 
 	raii::Image m_depthImage = nullptr;
 	raii::DeviceMemory m_depthImageMemory = nullptr;
 	raii::ImageView m_depthImageView = nullptr;
+	Format m_depthFormat = Format::eUndefined;
+
+	// Hi-Z occlusion culling, GPU driven mode only. Every pyramid texel holds the farthest depth of the 2x2 texels below it,
+	// level 0 being half the depth buffer. Objects are tested against last frame's pyramid and drawn, the pyramid is rebuilt
+	// from that depth, then the rejected ones are tested again so anything that just came into view still gets drawn.
+	bool m_occlusionCulling = true; // Unless --no-occlusion
+	raii::Image m_depthPyramid = nullptr;
+	raii::DeviceMemory m_depthPyramidMemory = nullptr;
+	raii::ImageView m_depthPyramidView = nullptr; // All levels, read by the cull pass
+	vector<raii::ImageView> m_depthPyramidLevelViews;
+	vector<Extent2D> m_depthPyramidLevelSizes;
+	DescriptorSetLayout m_pyramidDescriptorSetLayout = nullptr;
+	DescriptorUpdateTemplate m_pyramidDescriptorTemplate = nullptr; // Pushes when m_pushDescriptorSupported
+	PipelineLayout m_pyramidPipelineLayout = nullptr;
+	raii::Pipeline m_pyramidPipeline = nullptr;
+	raii::DescriptorPool m_pyramidDescriptorPool = nullptr;
+	vector<raii::DescriptorSet> m_pyramidDescriptorSets; // One per level, unless pushed
+	static constexpr uint32_t PYRAMID_GROUP_SIZE = 8;
 
 	raii::Image m_textureImage = nullptr;
 	raii::DeviceMemory m_textureImageMemory = nullptr;
 	raii::ImageView m_textureImageView = nullptr;
 	raii::Sampler m_textureSampler = nullptr;
 
-	raii::Buffer m_vertexBuffer = nullptr;
-	raii::DeviceMemory m_vertexBufferMemory = nullptr;
-	raii::Buffer m_indexBuffer = nullptr;
-	raii::DeviceMemory m_indexBufferMemory = nullptr;
+	// Bindless materials: every texture and sampler sits in one array of set 0 and materials pick theirs by index from a
+	// storage buffer, so any number of materials draws without a single rebind. Slots are handed out in order and never reused.
+	static constexpr uint32_t MAX_BINDLESS_TEXTURES = 4096;
+	static constexpr uint32_t MAX_BINDLESS_SAMPLERS = 16; // Size of samplers in Shader.slang
+	static constexpr uint32_t MAX_MATERIALS = 4096;
+	uint32_t m_bindlessTextureCapacity = 0;
+	uint32_t m_bindlessTextureCount = 0;
+	uint32_t m_bindlessSamplerCount = 0;
+	uint32_t m_materialCount = 0;
+	raii::Buffer m_materialBuffer = nullptr;
+	raii::DeviceMemory m_materialBufferMemory = nullptr;
+	MaterialData* m_materialBufferMapped = nullptr;
+
+	// Every mesh lives in these two buffers, so a whole scene draws with a single bind
+	static constexpr DeviceSize GEOMETRY_POOL_VERTEX_COUNT = 1 << 20;
+	static constexpr DeviceSize GEOMETRY_POOL_INDEX_BYTES = 16 << 20;
+	raii::Buffer m_geometryVertexBuffer = nullptr;
+	raii::DeviceMemory m_geometryVertexBufferMemory = nullptr;
+	raii::Buffer m_geometryIndexBuffer = nullptr;
+	raii::DeviceMemory m_geometryIndexBufferMemory = nullptr;
+	RangeAllocator m_vertexAllocator;
+	RangeAllocator m_indexAllocator;
+	vector<Mesh> m_meshes;
+	const string MODEL_PATH = "Model/Model.obj";
+	const string MESH_CACHE_DIRECTORY = "Cache/Mesh";
+
+	// Meshes past 65536 vertices either use 32 bit indices or, with this set, get split into 16 bit addressable parts
+	bool m_splitLargeMeshes = false;
+	vector<RenderObject> m_renderObjects;
+
+	SceneGraph m_scene;
+	SceneNode m_sceneRoot = INVALID_SCENE_NODE;
+
+	// World space bounds of every render object, refit into the BVH each frame, and the objects that survived culling
+	vector<Aabb> m_objectBounds;
+	Bvh m_objectBvh;
+	vector<uint32_t> m_visibleObjects;
+
+	// Camera of the current frame, also kept for picking
+	glm::mat4 m_view{ 1.0f };
+	glm::mat4 m_proj{ 1.0f };
+	glm::mat4 m_viewProj{ 1.0f };
+	optional<uint32_t> m_pickedObject; // Drawn highlighted
+	static constexpr float CAMERA_NEAR_PLANE = 0.1f;
+	static constexpr float CAMERA_FAR_PLANE = 10.0f;
+
+	// Projected error a LOD may have before the next finer one is picked, and the margin needed before going coarser again
+	static constexpr float LOD_ERROR_THRESHOLD_PIXELS = 1.0f;
+	static constexpr float LOD_HYSTERESIS = 0.25f;
+
+	// Visible objects sorted by draw key and grouped into instanced draws, in the same order as m_visibleObjects
+	RenderQueue m_renderQueue;
+	vector<DrawBatch> m_drawBatches;
+
+	// Pipeline and index buffer binds skipped because the state was already bound, over the whole run
+	atomic<uint64_t> m_redundantBindsSkipped{ 0 };
+	uint64_t m_frameCount = 0;
+
+	// Persistently mapped, one per frame in flight. Grown when the visible instances stop fitting.
+	vector<raii::Buffer> m_instanceBuffers;
+	vector<raii::DeviceMemory> m_instanceBuffersMemory;
+	vector<InstanceData*> m_instanceBuffersMapped;
+	uint32_t m_instanceCapacity = 0;
+
+	// GPU driven mode keeps every object in the instance buffer and only rewrites those that moved, once per frame in flight
+	vector<uint8_t> m_instanceFramesStale;
+
+	raii::Buffer m_gpuMeshBuffer = nullptr;
+	raii::DeviceMemory m_gpuMeshBufferMemory = nullptr;
+	vector<raii::Buffer> m_indirectBuffers;
+	vector<raii::DeviceMemory> m_indirectBuffersMemory;
+	vector<raii::Buffer> m_drawCountBuffers;
+	vector<raii::DeviceMemory> m_drawCountBuffersMemory;
+	vector<raii::Buffer> m_occludedBuffers; // One flag per object, set by the first cull phase for what it found occluded
+	vector<raii::DeviceMemory> m_occludedBuffersMemory;
+	raii::Buffer m_objectLodBuffer = nullptr; // Each object's current LOD, carried across frames for hysteresis, so shared by all of them
+	raii::DeviceMemory m_objectLodBufferMemory = nullptr;
+	uint32_t m_indirectCapacity = 0; // Draws per list, one list per phase, permutation slot and index slot
+	uint32_t m_cullPermutationCount = 0; // Permutation slots the indirect and count buffers have lists for
+	array<bool, INDEX_SLOT_COUNT> m_indexSlotUsed{};
+	static constexpr uint32_t INITIAL_INSTANCE_CAPACITY = 4096;
 
 	vector<raii::Buffer> m_uniformBuffers;
 	vector<raii::DeviceMemory> m_uniformBuffersMemory;
@@ -143,6 +530,12 @@ class HelloTriangleApplication
 	raii::CommandPool m_commandPool = nullptr;
 	vector<raii::CommandBuffer> m_commandBuffers;
 
+	// Indexed by frame, then by job system thread. Draw lists at least this long are recorded into secondaries in parallel.
+	vector<vector<RecordingPool>> m_recordingPools;
+	vector<CommandBuffer> m_secondaryCommandBuffers;
+	static constexpr size_t PARALLEL_RECORDING_MIN_DRAWS = 1024;
+	static constexpr size_t DRAWS_PER_SECONDARY = 512;
+
 	vector<raii::Semaphore> m_presentCompleteSemaphore;
 	vector<raii::Semaphore> m_renderFinishedSemaphore;
 	vector<raii::Fence> m_inFlightFences;
@@ -161,6 +554,7 @@ class HelloTriangleApplication
 		m_window.reset(glfwCreateWindow(m_width, m_height, "Vulkan", nullptr, nullptr));
 		glfwSetWindowUserPointer(m_window.get(), this);
 		glfwSetFramebufferSizeCallback(m_window.get(), FramebufferResizeCallback);
+		glfwSetMouseButtonCallback(m_window.get(), MouseButtonCallback);
 	}
 
 	static void FramebufferResizeCallback(GLFWwindow* window, int width, int height)
@@ -173,6 +567,23 @@ class HelloTriangleApplication
 		app->m_framebufferResized = true;
 	}
 
+	static void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+	{
+		if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) return;
+
+		auto app = static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+
+		double x = 0.0;
+		double y = 0.0;
+		int width = 0;
+		int height = 0;
+		glfwGetCursorPos(window, &x, &y);
+		glfwGetWindowSize(window, &width, &height);
+		if (width == 0 || height == 0) return;
+
+		app->SetPickedObject(app->PickObject(static_cast<float>(x / width), static_cast<float>(y / height)));
+	}
+
 	void InitVulkan()
 	{
 		CreateInstance();
@@ -180,20 +591,33 @@ class HelloTriangleApplication
 		CreateSurface();
 		PickPhysicalDevice();
 		CreateLogicalDevice();
+		CreatePipelineCache();
+		CreatePipelineBinaryArchive();
+		CreateShaderLibrary();
+		m_pipelineRegistry.Init(m_device, m_pipelineCache, m_shaderLibrary, m_pipelineBackend, m_maintenance5Supported);
 		CreateSwapChain();
 		CreateImageViews();
-		CreateDescriptorSetLayout();
+		CreateShaderLayouts();
 		CreateGraphicsPipeline();
 		CreateCommandPool();
 		CreateDepthResources();
+		CreateDepthPyramid();
 		CreateTextureImage();
 		CreateTextureImageView();
 		CreateTextureSampler();
-		CreateVertexBuffer();
-		CreateIndexBuffer();
+		CreateGeometryPool();
+		if (filesystem::exists(MODEL_PATH)) m_meshes = LoadModel(MODEL_PATH);
+		else m_meshes.push_back(CreateMesh(CookMesh(vertices, vector<uint32_t>(indices.begin(), indices.end()))));
+
+		m_sceneRoot = m_scene.CreateNode();
+		for (uint32_t i = 0; i < m_meshes.size(); i++) m_renderObjects.push_back({ i, 0, m_scene.CreateNode(m_sceneRoot) });
 		CreateUniformBuffers();
+		CreateInstanceBuffers(INITIAL_INSTANCE_CAPACITY);
 		CreateDescriptorPool();
+		CreateMaterialBuffer();
 		CreateDescriptorSets();
+		CreateDefaultMaterial();
+		CreateGpuCulling();
 		CreateCommandBuffer();
 		CreateSyncObjects();
 	}
@@ -207,6 +631,15 @@ class HelloTriangleApplication
 		}
 
 		m_device.waitIdle();
+
+		if (m_verbose && m_frameCount) cout << "render queue: " << m_redundantBindsSkipped.load() << " redundant binds skipped over " << m_frameCount << " frames" << endl;
+		if (m_verbose) cout << "pipeline registry: " << m_pipelineRegistry.GetPipelineCount() << " pipelines compiled in " << m_pipelineRegistry.GetCompileMilliseconds()
+			<< " ms of background time, " << m_pipelineRegistry.GetFastLinkCount() << " fast linked, " << m_pipelineRegistry.GetBinaryLoadCount() << " loaded from binaries, "
+			<< m_drawsSkippedNotReady.load() << " draws skipped waiting for one" << endl;
+
+		// Compiles still queued are dropped, the ones that finished are kept in the pipeline cache
+		m_pipelineRegistry.Shutdown();
+		SavePipelineCache();
 	}
 
 	void CleanupSwapChain()
@@ -235,6 +668,8 @@ class HelloTriangleApplication
 		CleanupSwapChain();
 		CreateSwapChain();
 		CreateImageViews();
+		CreateDepthResources();
+		CreateDepthPyramid();
 	}
 
 	void CreateInstance()
@@ -347,13 +782,21 @@ class HelloTriangleApplication
 					<
 					PhysicalDeviceFeatures2,
 					PhysicalDeviceVulkan11Features,
+					PhysicalDeviceVulkan12Features,
 					PhysicalDeviceVulkan13Features,
 					PhysicalDeviceExtendedDynamicStateFeaturesEXT
 					>();
+				const PhysicalDeviceVulkan12Features& vulkan12Features = features.template get<PhysicalDeviceVulkan12Features>();
 				
 				bool supportsRequiredFeatures =
 					features.template get<PhysicalDeviceFeatures2>().features.samplerAnisotropy &&
 					features.template get<PhysicalDeviceVulkan11Features>().shaderDrawParameters &&
+					vulkan12Features.descriptorIndexing &&
+					vulkan12Features.shaderSampledImageArrayNonUniformIndexing &&
+					vulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+					vulkan12Features.descriptorBindingUpdateUnusedWhilePending &&
+					vulkan12Features.descriptorBindingPartiallyBound &&
+					vulkan12Features.runtimeDescriptorArray &&
 					features.template get<PhysicalDeviceVulkan13Features>().synchronization2 &&
 					features.template get<PhysicalDeviceVulkan13Features>().dynamicRendering &&
 					features.template get<PhysicalDeviceExtendedDynamicStateFeaturesEXT>().extendedDynamicState;
@@ -392,20 +835,112 @@ class HelloTriangleApplication
 		PhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {};
 		extendedDynamicStateFeatures.extendedDynamicState = true;
 
+		vector<const char*> enabledExtensions = m_requiredDeviceExtension;
+		vector<ExtensionProperties> availableDeviceExtensions = m_physicalDevice.enumerateDeviceExtensionProperties();
+		auto isExtensionAvailable = [&availableDeviceExtensions](const char* name)
+		{
+			return ranges::any_of(availableDeviceExtensions, [name](const ExtensionProperties& extension) { return strcmp(extension.extensionName, name) == 0; });
+		};
+
+		m_indexTypeUint8Supported =
+			isExtensionAvailable(EXTIndexTypeUint8ExtensionName) &&
+			m_physicalDevice.getFeatures2<PhysicalDeviceFeatures2, PhysicalDeviceIndexTypeUint8FeaturesEXT>().get<PhysicalDeviceIndexTypeUint8FeaturesEXT>().indexTypeUint8;
+		if (m_indexTypeUint8Supported) enabledExtensions.push_back(EXTIndexTypeUint8ExtensionName);
+
+		m_pushDescriptorSupported = isExtensionAvailable(KHRPushDescriptorExtensionName);
+		if (m_pushDescriptorSupported) enabledExtensions.push_back(KHRPushDescriptorExtensionName);
+
+		PhysicalDeviceIndexTypeUint8FeaturesEXT indexTypeUint8Features = {};
+		indexTypeUint8Features.indexTypeUint8 = true;
+
+		// Draw pipeline backend, stepping down to what the device has: shader objects, then pipeline libraries, then monolithic pipelines
+		auto backendFeatures = m_physicalDevice.getFeatures2<PhysicalDeviceFeatures2, PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT, PhysicalDeviceShaderObjectFeaturesEXT>();
+		const bool shaderObjectSupported = isExtensionAvailable(EXTShaderObjectExtensionName) && backendFeatures.get<PhysicalDeviceShaderObjectFeaturesEXT>().shaderObject;
+		const bool pipelineLibrarySupported =
+			isExtensionAvailable(KHRPipelineLibraryExtensionName) &&
+			isExtensionAvailable(EXTGraphicsPipelineLibraryExtensionName) &&
+			backendFeatures.get<PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>().graphicsPipelineLibrary;
+		if (m_pipelineBackend == PipelineBackend::ShaderObject && !shaderObjectSupported) m_pipelineBackend = PipelineBackend::Library;
+		if (m_pipelineBackend == PipelineBackend::Library && !pipelineLibrarySupported) m_pipelineBackend = PipelineBackend::Monolithic;
+
+		if (m_pipelineBackend == PipelineBackend::ShaderObject) enabledExtensions.push_back(EXTShaderObjectExtensionName);
+		if (m_pipelineBackend == PipelineBackend::Library)
+		{
+			enabledExtensions.push_back(KHRPipelineLibraryExtensionName);
+			enabledExtensions.push_back(EXTGraphicsPipelineLibraryExtensionName);
+		}
+
+		PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures = {};
+		pipelineLibraryFeatures.graphicsPipelineLibrary = true;
+
+		PhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures = {};
+		shaderObjectFeatures.shaderObject = true;
+
+		// Maintenance5 lets pipelines take shader code inline, pipeline binaries also need it for the capture flag
+		auto binaryFeatures = m_physicalDevice.getFeatures2<PhysicalDeviceFeatures2, PhysicalDevicePipelineBinaryFeaturesKHR, PhysicalDeviceMaintenance5FeaturesKHR>();
+		m_maintenance5Supported = isExtensionAvailable(KHRMaintenance5ExtensionName) && binaryFeatures.get<PhysicalDeviceMaintenance5FeaturesKHR>().maintenance5;
+		if (m_maintenance5Supported) enabledExtensions.push_back(KHRMaintenance5ExtensionName);
+
+		m_pipelineBinariesEnabled =
+			m_maintenance5Supported &&
+			isExtensionAvailable(KHRPipelineBinaryExtensionName) &&
+			binaryFeatures.get<PhysicalDevicePipelineBinaryFeaturesKHR>().pipelineBinaries &&
+			!m_physicalDevice.getProperties2<PhysicalDeviceProperties2, PhysicalDevicePipelineBinaryPropertiesKHR>().get<PhysicalDevicePipelineBinaryPropertiesKHR>().pipelineBinaryPrefersInternalCache;
+		if (m_pipelineBinariesEnabled) enabledExtensions.push_back(KHRPipelineBinaryExtensionName);
+
+		PhysicalDevicePipelineBinaryFeaturesKHR pipelineBinaryFeatures = {};
+		pipelineBinaryFeatures.pipelineBinaries = true;
+
+		PhysicalDeviceMaintenance5FeaturesKHR maintenance5Features = {};
+		maintenance5Features.maintenance5 = true;
+
+		auto indirectFeatures = m_physicalDevice.getFeatures2<PhysicalDeviceFeatures2, PhysicalDeviceVulkan12Features>();
+		m_drawIndirectCountSupported = indirectFeatures.get<PhysicalDeviceVulkan12Features>().drawIndirectCount;
+		m_drawIndirectFirstInstanceSupported = indirectFeatures.get<PhysicalDeviceFeatures2>().features.drawIndirectFirstInstance;
+		if (!m_drawIndirectCountSupported || !m_drawIndirectFirstInstanceSupported) m_gpuDriven = false;
+		featureChain.features.drawIndirectFirstInstance = m_drawIndirectFirstInstanceSupported;
+
+		// Descriptor indexing backs the bindless material textures
+		PhysicalDeviceVulkan12Features vulkan12Features = {};
+		vulkan12Features.drawIndirectCount = m_drawIndirectCountSupported;
+		vulkan12Features.descriptorIndexing = true;
+		vulkan12Features.shaderSampledImageArrayNonUniformIndexing = true;
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = true;
+		vulkan12Features.descriptorBindingUpdateUnusedWhilePending = true;
+		vulkan12Features.descriptorBindingPartiallyBound = true;
+		vulkan12Features.runtimeDescriptorArray = true;
+
 		StructureChain
 			<
 			PhysicalDeviceFeatures2,
 			PhysicalDeviceVulkan11Features,
+			PhysicalDeviceVulkan12Features,
 			PhysicalDeviceVulkan13Features,
-			PhysicalDeviceExtendedDynamicStateFeaturesEXT
+			PhysicalDeviceExtendedDynamicStateFeaturesEXT,
+			PhysicalDeviceIndexTypeUint8FeaturesEXT,
+			PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT,
+			PhysicalDeviceShaderObjectFeaturesEXT,
+			PhysicalDevicePipelineBinaryFeaturesKHR,
+			PhysicalDeviceMaintenance5FeaturesKHR
 			>
 			featureStructureChain
 		{
 			featureChain,
 			vulkan11Features,
+			vulkan12Features,
 			vulkan13Features,
-			extendedDynamicStateFeatures
+			extendedDynamicStateFeatures,
+			indexTypeUint8Features,
+			pipelineLibraryFeatures,
+			shaderObjectFeatures,
+			pipelineBinaryFeatures,
+			maintenance5Features
 		};
+		if (!m_indexTypeUint8Supported) featureStructureChain.unlink<PhysicalDeviceIndexTypeUint8FeaturesEXT>();
+		if (m_pipelineBackend != PipelineBackend::Library) featureStructureChain.unlink<PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>();
+		if (m_pipelineBackend != PipelineBackend::ShaderObject) featureStructureChain.unlink<PhysicalDeviceShaderObjectFeaturesEXT>();
+		if (!m_pipelineBinariesEnabled) featureStructureChain.unlink<PhysicalDevicePipelineBinaryFeaturesKHR>();
+		if (!m_maintenance5Supported) featureStructureChain.unlink<PhysicalDeviceMaintenance5FeaturesKHR>();
 
 		constexpr float queuePriority = 0.5f;
 		DeviceQueueCreateInfo queueCreateInfo = {};
@@ -417,8 +952,8 @@ class HelloTriangleApplication
 		createInfo.pNext = &featureStructureChain.get<PhysicalDeviceFeatures2>();
 		createInfo.queueCreateInfoCount = 1;
 		createInfo.pQueueCreateInfos = &queueCreateInfo;
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(m_requiredDeviceExtension.size());
-		createInfo.ppEnabledExtensionNames = m_requiredDeviceExtension.data();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 		m_device = raii::Device{ m_physicalDevice, createInfo };
 		m_queue = raii::Queue{ m_device, m_queueIndex, 0 };
@@ -468,140 +1003,249 @@ class HelloTriangleApplication
 		}
 	}
 
-	void CreateDescriptorSetLayout()
-	{
-		array bindingFlags =
-		{
-			DescriptorSetLayoutBinding
-			(
-				0,
-				DescriptorType::eUniformBuffer,
-				1,
-				ShaderStageFlagBits::eVertex,
-				nullptr
-			),
-			DescriptorSetLayoutBinding
-			(
-				1,
-				DescriptorType::eCombinedImageSampler,
-				1,
-				ShaderStageFlagBits::eFragment,
-				nullptr
-			)
+	ShaderReflection ReflectShader(uint64_t shader) const
+	{
+		ShaderReflection reflection;
+		if (!ReflectSpirv(m_shaderLibrary.GetCode(shader), reflection)) throw runtime_error("failed to reflect shader module!");
+		return reflection;
+	}
+
+	// The C++ side pushes its structs with fixed stages, reflection has to agree on both
+	static void CheckPushConstants(const ShaderLayout& layout, ShaderStageFlags stages, uint32_t size, const char* name)
+	{
+		const bool matches = layout.pushConstantRanges.size() == 1 && layout.pushConstantRanges[0].stageFlags == stages && layout.pushConstantRanges[0].size == size;
+		if (!matches) throw runtime_error(string(name) + " doesn't match the shader's push constants!");
+	}
+
+	// Every layout is reflected from the shader modules. Graphics, culling and pyramid resources sit in sets 0, 1 and 2 of the
+	// shared source, so each module's layout has empty layouts below its own set, and those are one and the same layout.
+	void CreateShaderLayouts()
+	{
+		m_layoutCache.Init(m_device);
+		m_descriptorWriter.Init(m_device, m_layoutCache);
+
+		// Sized to the device, the texture array is the one binding with no fixed count in the shader
+		auto properties = m_physicalDevice.getProperties2<PhysicalDeviceProperties2, PhysicalDeviceVulkan12Properties>();
+		const PhysicalDeviceVulkan12Properties& vulkan12Properties = properties.get<PhysicalDeviceVulkan12Properties>();
+		m_bindlessTextureCapacity = min
+		({
+			MAX_BINDLESS_TEXTURES,
+			vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages / static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT)
+		});
+
+		// Sampler and texture slots fill up over time, possibly while earlier frames using the set are still in flight.
+		// The cache makes every array binding partially bound and update after bind for that.
+		const ShaderReflection drawReflection = ReflectShader(m_drawShader);
+		const ShaderLayout drawLayout = m_layoutCache.GetShaderLayout(drawReflection, m_bindlessTextureCapacity);
+		CheckPushConstants(drawLayout, ShaderStageFlagBits::eVertex, sizeof(DrawPC), "DrawPC");
+		m_descriptorSetLayout = drawLayout.setLayouts.at(0);
+		m_descriptorTemplate = m_descriptorWriter.GetTemplate(drawLayout, 0);
+		m_pipelineLayout = drawLayout.pipelineLayout;
+		if (m_pipelineBackend == PipelineBackend::ShaderObject) m_pipelineRegistry.SetLayoutInterface(m_pipelineLayout, drawLayout.setLayouts, drawLayout.pushConstantRanges);
+
+		const ReflectedEntryPoint* vertexEntryPoint = drawReflection.FindEntryPoint("vertMain");
+		if (!vertexEntryPoint) throw runtime_error("shader module has no vertMain!");
+		m_vertexInputs = vertexEntryPoint->vertexInputs;
+
+		const ShaderLayout cullLayout = m_layoutCache.GetShaderLayout(ReflectShader(m_cullShader), 0);
+		CheckPushConstants(cullLayout, ShaderStageFlagBits::eCompute, sizeof(CullPC), "CullPC");
+		m_cullDescriptorSetLayout = cullLayout.setLayouts.at(1);
+		m_cullDescriptorTemplate = m_descriptorWriter.GetTemplate(cullLayout, 1, PipelineBindPoint::eCompute);
+		m_cullPipelineLayout = cullLayout.pipelineLayout;
+
+		// A level's set is used by one dispatch and rebuilt with the swap chain, so it is pushed when it can be
+		const ShaderLayout pyramidLayout = m_layoutCache.GetShaderLayout(ReflectShader(m_pyramidShader), 0, m_pushDescriptorSupported ? 2 : NO_PUSH_DESCRIPTOR_SET);
+		CheckPushConstants(pyramidLayout, ShaderStageFlagBits::eCompute, sizeof(PyramidPC), "PyramidPC");
+		m_pyramidDescriptorSetLayout = pyramidLayout.setLayouts.at(2);
+		m_pyramidDescriptorTemplate = m_descriptorWriter.GetTemplate(pyramidLayout, 2, PipelineBindPoint::eCompute);
+		m_pyramidPipelineLayout = pyramidLayout.pipelineLayout;
+
+		if (m_verbose) cout << "layouts: " << m_layoutCache.GetSetLayoutCount() << " set layouts, " << m_layoutCache.GetPipelineLayoutCount() << " pipeline layouts and "
+			<< m_descriptorWriter.GetTemplateCount() << " update templates from 3 shader modules" << endl;
+	}
+
+	void CreatePipelineCache()
+	{
+		const PhysicalDeviceProperties properties = m_physicalDevice.getProperties();
+		m_pipelineCacheIdentity.vendorID = properties.vendorID;
+		m_pipelineCacheIdentity.deviceID = properties.deviceID;
+		m_pipelineCacheIdentity.driverVersion = properties.driverVersion;
+		memcpy(m_pipelineCacheIdentity.pipelineCacheUUID, properties.pipelineCacheUUID.data(), sizeof(m_pipelineCacheIdentity.pipelineCacheUUID));
+
+		MappedFile file;
+		span<const byte> data;
+		if (filesystem::exists(PIPELINE_CACHE_PATH))
+		{
+			file = MappedFile(PIPELINE_CACHE_PATH);
+			data = ParsePipelineCache(file.Bytes(), m_pipelineCacheIdentity);
+		}
+
+		PipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.data();
+
+		m_pipelineCache = raii::PipelineCache{ m_device, cacheInfo };
+		m_pipelineCacheWarm = !data.empty();
+		m_pipelineCacheSavedHash = data.empty() ? 0 : HashBytes(data);
+		m_pipelineCacheSavedTime = chrono::steady_clock::now();
+	}
+
+	// The archive is keyed by the driver's global pipeline key as well as the device and driver UUIDs, so a driver update starts it over
+	void CreatePipelineBinaryArchive()
+	{
+		if (!m_pipelineBinariesEnabled) return;
+
+		const auto properties = m_physicalDevice.getProperties2<PhysicalDeviceProperties2, PhysicalDeviceIDProperties>();
+		const PhysicalDeviceIDProperties& idProperties = properties.get<PhysicalDeviceIDProperties>();
+		const PipelineBinaryKeyKHR globalKey = m_device.getPipelineKeyKHR();
+
+		PipelineBinaryArchiveHeader identity{};
+		memcpy(identity.deviceUUID, idProperties.deviceUUID.data(), sizeof(identity.deviceUUID));
+		memcpy(identity.driverUUID, idProperties.driverUUID.data(), sizeof(identity.driverUUID));
+		identity.globalKey.size = min(globalKey.keySize, static_cast<uint32_t>(PIPELINE_BINARY_KEY_SIZE));
+		memcpy(identity.globalKey.bytes.data(), globalKey.key.data(), identity.globalKey.size);
+
+		if (m_pipelineBinaryArchive.Load(PIPELINE_BINARY_ARCHIVE_PATH, identity) && m_verbose) cout << "pipeline binaries: " << m_pipelineBinaryArchive.Size() << " pipelines archived" << endl;
+		m_pipelineRegistry.SetBinaryArchive(&m_pipelineBinaryArchive);
+	}
+
+	// Opening the archive only maps it and checks its table, so startup doesn't grow with the shader count.
+	// It is repacked first when it is missing or older than any compiled module. Modules built from source then replace
+	// the archived ones, only the ones whose inputs changed since the last run go through the compiler.
+	void CreateShaderLibrary()
+	{
+		m_shaderLibrary.Init(m_device);
+
+		vector<filesystem::path> modulePaths;
+		for (const filesystem::directory_entry& entry : filesystem::directory_iterator(SHADER_DIRECTORY))
+		{
+			if (entry.is_regular_file() && entry.path().extension() == ".spv") modulePaths.push_back(entry.path());
+		}
+
+		error_code error;
+		const filesystem::file_time_type archiveTime = filesystem::last_write_time(SHADER_ARCHIVE_PATH, error);
+		const bool stale = error || ranges::any_of(modulePaths, [&](const filesystem::path& path) { return filesystem::last_write_time(path) > archiveTime; });
+
+		if (stale || !m_shaderLibrary.Open(SHADER_ARCHIVE_PATH))
+		{
+			if (!WriteShaderArchive(SHADER_ARCHIVE_PATH, modulePaths) || !m_shaderLibrary.Open(SHADER_ARCHIVE_PATH)) throw runtime_error("failed to pack shader archive: " + SHADER_ARCHIVE_PATH);
+		}
+
+		if (m_verbose) cout << "shaders: " << m_shaderLibrary.GetModuleCount() << " modules mapped from " << SHADER_ARCHIVE_PATH << (m_maintenance5Supported ? ", passed to pipelines inline" : "") << endl;
+
+		if (filesystem::exists(SHADER_SOURCE_PATH))
+		{
+			const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+			const vector<ShaderCompileRequest> requests =
+			{
+				{ "Draw", SHADER_SOURCE_PATH, { "vertMain", "vertPulledMain", "vertIndirectMain", "fragMain" }, {} },
+				{ "Cull", SHADER_SOURCE_PATH, { "cullMain" }, {} },
+				{ "DepthPyramid", SHADER_SOURCE_PATH, { "buildDepthPyramidMain" }, {} }
+			};
+			ShaderCompiler compiler(SHADER_CACHE_DIRECTORY);
+			compiler.Compile(requests, m_shaderLibrary);
+
+			const float milliseconds = chrono::duration<float, milli>(chrono::steady_clock::now() - startTime).count();
+			if (m_verbose) cout << "shaders: " << compiler.GetCompileCount() << " compiled, " << compiler.GetCacheHitCount() << " from cache in " << milliseconds << " ms" << endl;
+		}
+
+		auto findShader = [this](const char* name)
+		{
+			const uint64_t shader = m_shaderLibrary.Find(name);
+			if (!shader) throw runtime_error(string("missing shader module: ") + name);
+			return shader;
 		};
+		m_drawShader = findShader("Draw");
+		m_cullShader = findShader("Cull");
+		m_pyramidShader = findShader("DepthPyramid");
+	}
 
-		DescriptorSetLayoutCreateInfo layoutInfo{};
-		layoutInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
-		layoutInfo.pBindings = bindingFlags.data();
+	// Skipped when the driver has nothing new since the last save
+	void SavePipelineCache()
+	{
+		m_pipelineCacheSavedTime = chrono::steady_clock::now();
+		if (m_pipelineBinariesEnabled) m_pipelineBinaryArchive.Save(PIPELINE_BINARY_ARCHIVE_PATH);
+
+		const vector<uint8_t> data = m_pipelineCache.getData();
+		const uint64_t dataHash = HashBytes(data.data(), data.size());
+		if (data.empty() || dataHash == m_pipelineCacheSavedHash) return;
 
-		m_descriptorSetLayout = raii::DescriptorSetLayout{ m_device, layoutInfo };
+		if (WritePipelineCache(PIPELINE_CACHE_PATH, m_pipelineCacheIdentity, as_bytes(span(data)))) m_pipelineCacheSavedHash = dataHash;
 	}
 
+	// Only queues the draw pipelines, they finish on the registry's threads. The compute pipelines are needed before the first frame and are built here.
 	void CreateGraphicsPipeline()
 	{
-		raii::ShaderModule shaderModule = CreateShaderModule(ReadFile("Shader/Slang.spv"));
-
-		PipelineShaderStageCreateInfo vertShaderStageInfo{};
-		vertShaderStageInfo.stage = ShaderStageFlagBits::eVertex;
-		vertShaderStageInfo.module = shaderModule;
-		vertShaderStageInfo.pName = "vertMain";
-
-		PipelineShaderStageCreateInfo fragShaderStageInfo{};
-		fragShaderStageInfo.stage = ShaderStageFlagBits::eFragment;
-		fragShaderStageInfo.module = shaderModule;
-		fragShaderStageInfo.pName = "fragMain";
-
-		array<PipelineShaderStageCreateInfo, 2> shaderStages = { vertShaderStageInfo, fragShaderStageInfo };
-
-		VertexInputBindingDescription bindingDescription = Vertex::getBindingDescription();
-		array<VertexInputAttributeDescription, 3> attributeDescriptions = Vertex::getAttributeDescriptions();
-
-		PipelineVertexInputStateCreateInfo vertexInputInfo{};
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-		PipelineInputAssemblyStateCreateInfo inputAssembly{};
-		inputAssembly.topology = PrimitiveTopology::eTriangleList;
-
-		PipelineViewportStateCreateInfo viewportState{};
-		viewportState.viewportCount = 1;
-		viewportState.scissorCount = 1;
-
-		PipelineRasterizationStateCreateInfo rasterizer{};
-		rasterizer.depthClampEnable = False;
-		rasterizer.rasterizerDiscardEnable = False;
-		rasterizer.polygonMode = PolygonMode::eFill;
-		rasterizer.cullMode = CullModeFlagBits::eBack;
-		rasterizer.frontFace = FrontFace::eCounterClockwise;
-		rasterizer.depthBiasEnable = False;
-		rasterizer.depthBiasSlopeFactor = 1.0f;
-		rasterizer.lineWidth = 1.0f;
-
-		PipelineMultisampleStateCreateInfo multisampling{};
-		multisampling.rasterizationSamples = SampleCountFlagBits::e1;
-		multisampling.sampleShadingEnable = False;
-
-		PipelineDepthStencilStateCreateInfo depthStencil{};
-		depthStencil.depthTestEnable = True;
-		depthStencil.depthWriteEnable = True;
-		depthStencil.depthCompareOp = CompareOp::eLess;
-		depthStencil.depthBoundsTestEnable = False;
-		depthStencil.stencilTestEnable = False;
-
-		PipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.blendEnable = False;
-		colorBlendAttachment.colorWriteMask =
-			ColorComponentFlagBits::eR |
-			ColorComponentFlagBits::eG |
-			ColorComponentFlagBits::eB |
-			ColorComponentFlagBits::eA;
-
-		PipelineColorBlendStateCreateInfo colorBlending{};
-		colorBlending.logicOpEnable = False;
-		colorBlending.logicOp = LogicOp::eCopy;
-		colorBlending.attachmentCount = 1;
-		colorBlending.pAttachments = &colorBlendAttachment;
-
-		vector dynamicStates = { DynamicState::eViewport, DynamicState::eScissor };
-
-		PipelineDynamicStateCreateInfo dynamicState{};
-		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-		dynamicState.pDynamicStates = dynamicStates.data();
-
-		PipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.setLayoutCount = 1;
-		pipelineLayoutInfo.pSetLayouts = &*m_descriptorSetLayout;
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
-
-		m_pipelineLayout = raii::PipelineLayout{ m_device, pipelineLayoutInfo };
-
-		GraphicsPipelineCreateInfo graphicsPipelineCreateInfo{};
-		graphicsPipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-		graphicsPipelineCreateInfo.pStages = shaderStages.data();
-		graphicsPipelineCreateInfo.pVertexInputState = &vertexInputInfo;
-		graphicsPipelineCreateInfo.pInputAssemblyState = &inputAssembly;
-		graphicsPipelineCreateInfo.pViewportState = &viewportState;
-		graphicsPipelineCreateInfo.pRasterizationState = &rasterizer;
-		graphicsPipelineCreateInfo.pMultisampleState = &multisampling;
-		graphicsPipelineCreateInfo.pDepthStencilState = &depthStencil;
-		graphicsPipelineCreateInfo.pColorBlendState = &colorBlending;
-		graphicsPipelineCreateInfo.pDynamicState = &dynamicState;
-		graphicsPipelineCreateInfo.layout = m_pipelineLayout;
-
-		PipelineRenderingCreateInfo pipelineRenderingCreateInfo{};
-		pipelineRenderingCreateInfo.colorAttachmentCount = 1;
-		pipelineRenderingCreateInfo.pColorAttachmentFormats = &m_swapChainSurfaceFormat.format;
-		pipelineRenderingCreateInfo.depthAttachmentFormat = FindDepthFormat();
-
-		StructureChain<GraphicsPipelineCreateInfo, PipelineRenderingCreateInfo> pipelineCreateInfoChain
-		{
-			graphicsPipelineCreateInfo,
-			pipelineRenderingCreateInfo
-		};
+		const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+		GraphicsPipelineDesc desc{};
+		desc.shader = m_drawShader;
+		desc.layout = m_pipelineLayout;
+		desc.colorFormat = m_swapChainSurfaceFormat.format;
+		desc.depthFormat = FindDepthFormat();
+
+		ApplyShaderPermutation(desc, DEFAULT_SHADER_PERMUTATION);
+		desc.SetEntryPoints("vertMain", "fragMain");
+
+		// Attributes follow vertMain's inputs, packed in location order, which has to add up to Vertex
+		for (const ReflectedVertexInput& input : m_vertexInputs)
+		{
+			if (input.location >= desc.vertexAttributes.size()) throw runtime_error("too many vertex inputs!");
+			desc.vertexAttributes[input.location] = { input.format, desc.vertexStride };
+			desc.vertexStride += VertexFormatSize(input.format);
+		}
+		if (desc.vertexStride != sizeof(Vertex)) throw runtime_error("Vertex doesn't match the shader's vertex inputs!");
+		m_drawPipelineDescs[DRAW_PIPELINE_VERTEX_INPUT] = desc;
+
+		// Indirect draws can't push per draw constants, their firstInstance is the object index instead
+		desc.SetEntryPoints("vertIndirectMain", "fragMain");
+		m_drawPipelineDescs[DRAW_PIPELINE_INDIRECT] = desc;
+
+		desc.SetEntryPoints("vertPulledMain", "fragMain");
+		desc.vertexStride = 0;
+		desc.vertexAttributes = {};
+		m_drawPipelineDescs[DRAW_PIPELINE_PULLED] = desc;
+
+		// The path in use first, then its fallback
+		const uint32_t firstPipeline = m_gpuDriven ? DRAW_PIPELINE_INDIRECT : m_vertexPulling ? DRAW_PIPELINE_PULLED : DRAW_PIPELINE_VERTEX_INPUT;
+		m_pipelineRegistry.Request(m_drawPipelineDescs[firstPipeline]);
+		for (uint32_t pipeline = 0; pipeline < DRAW_PIPELINE_COUNT; pipeline++)
+		{
+			if (IsDrawPipelineInUse(pipeline)) m_pipelineRegistry.Request(m_drawPipelineDescs[pipeline]);
+		}
+
+		CreateCullPipeline();
+		CreatePyramidPipeline();
+
+		const float milliseconds = chrono::duration<float, milli>(chrono::steady_clock::now() - startTime).count();
+		const char* backendNames[] = { "monolithic pipelines", "pipeline libraries", "shader objects" };
+		if (m_verbose) cout << "pipelines: compute pipelines created in " << milliseconds << " ms from a " << (m_pipelineCacheWarm ? "warm" : "cold") << " pipeline cache, "
+			<< DRAW_PIPELINE_COUNT << " draw pipelines compiling in the background as " << backendNames[static_cast<uint32_t>(m_pipelineBackend)] << endl;
+	}
+
+	void CreateCullPipeline()
+	{
+		ComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.stage.stage = ShaderStageFlagBits::eCompute;
+		pipelineInfo.stage.module = m_shaderLibrary.GetShaderModule(m_cullShader);
+		pipelineInfo.stage.pName = "cullMain";
+		pipelineInfo.layout = m_cullPipelineLayout;
+
+		m_cullPipeline = raii::Pipeline{ m_device, m_pipelineCache, pipelineInfo };
+	}
+
+	// Downsamples one pyramid level per dispatch, from the depth buffer or the level above
+	void CreatePyramidPipeline()
+	{
+		ComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.stage.stage = ShaderStageFlagBits::eCompute;
+		pipelineInfo.stage.module = m_shaderLibrary.GetShaderModule(m_pyramidShader);
+		pipelineInfo.stage.pName = "buildDepthPyramidMain";
+		pipelineInfo.layout = m_pyramidPipelineLayout;
 
-		m_graphicsPipeline = raii::Pipeline{ m_device, nullptr, pipelineCreateInfoChain.get<GraphicsPipelineCreateInfo>() };
+		m_pyramidPipeline = raii::Pipeline{ m_device, m_pipelineCache, pipelineInfo };
 	}
 
 	void CreateCommandPool()
@@ -611,34 +1255,172 @@ class HelloTriangleApplication
 		poolInfo.queueFamilyIndex = m_queueIndex;
 
 		m_commandPool = raii::CommandPool{ m_device, poolInfo };
+
+		// Every job system thread gets its own pool per frame, so workers never share a pool while recording
+		CommandPoolCreateInfo recordingPoolInfo{};
+		recordingPoolInfo.flags = CommandPoolCreateFlagBits::eTransient;
+		recordingPoolInfo.queueFamilyIndex = m_queueIndex;
+
+		m_recordingPools.resize(MAX_FRAMES_IN_FLIGHT);
+		for (vector<RecordingPool>& framePools : m_recordingPools)
+		{
+			framePools.resize(JobSystem::Get().GetThreadCount());
+			for (RecordingPool& recordingPool : framePools) recordingPool.pool = raii::CommandPool{ m_device, recordingPoolInfo };
+		}
 	}
 
+	// Sampled as well, the depth pyramid is built from it
 	void CreateDepthResources()
 	{
-		Format depthFormat = FindDepthFormat();
+		m_depthFormat = FindDepthFormat();
 		CreateImage
 		(
 			m_swapChainExtent.width,
 			m_swapChainExtent.height,
-			depthFormat,
+			m_depthFormat,
 			ImageTiling::eOptimal,
-			ImageUsageFlagBits::eDepthStencilAttachment,
+			ImageUsageFlagBits::eDepthStencilAttachment | ImageUsageFlagBits::eSampled,
 			MemoryPropertyFlagBits::eDeviceLocal,
 			m_depthImage,
 			m_depthImageMemory
 		);
 
-		m_depthImageView = CreateImageView(m_depthImage, depthFormat, ImageAspectFlagBits::eDepth);
+		m_depthImageView = CreateImageView(m_depthImage, m_depthFormat, ImageAspectFlagBits::eDepth);
 		TransitionImageLayout(m_depthImage, ImageLayout::eUndefined, ImageLayout::eDepthStencilAttachmentOptimal);
 	}
 
+	// Level sizes round down like any mip chain, the last row and column of a level fold in the odd one below so no depth is
+	// dropped. The pyramid starts out at the far plane, which occludes nothing.
+	void CreateDepthPyramid()
+	{
+		m_pyramidDescriptorSets.clear();
+		m_depthPyramidLevelViews.clear();
+		m_depthPyramidLevelSizes.clear();
+
+		auto halve = [](Extent2D size) { return Extent2D{ max(size.width / 2, 1u), max(size.height / 2, 1u) }; };
+		for (Extent2D levelSize = halve(m_swapChainExtent);; levelSize = halve(levelSize))
+		{
+			m_depthPyramidLevelSizes.push_back(levelSize);
+			if (levelSize.width == 1 && levelSize.height == 1) break;
+		}
+
+		const uint32_t levelCount = static_cast<uint32_t>(m_depthPyramidLevelSizes.size());
+
+		ImageCreateInfo imageInfo{};
+		imageInfo.imageType = ImageType::e2D;
+		imageInfo.extent = Extent3D{ m_depthPyramidLevelSizes[0].width, m_depthPyramidLevelSizes[0].height, 1 };
+		imageInfo.mipLevels = levelCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = Format::eR32Sfloat;
+		imageInfo.tiling = ImageTiling::eOptimal;
+		imageInfo.initialLayout = ImageLayout::eUndefined;
+		imageInfo.usage = ImageUsageFlagBits::eStorage | ImageUsageFlagBits::eSampled | ImageUsageFlagBits::eTransferDst;
+		imageInfo.sharingMode = SharingMode::eExclusive;
+		imageInfo.samples = SampleCountFlagBits::e1;
+		m_depthPyramid = raii::Image{ m_device, imageInfo };
+
+		MemoryRequirements memRequirements = m_depthPyramid.getMemoryRequirements();
+		MemoryAllocateInfo allocInfo{};
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, MemoryPropertyFlagBits::eDeviceLocal);
+
+		m_depthPyramidMemory = raii::DeviceMemory{ m_device, allocInfo };
+		m_depthPyramid.bindMemory(*m_depthPyramidMemory, 0);
+
+		ImageViewCreateInfo viewInfo{};
+		viewInfo.image = *m_depthPyramid;
+		viewInfo.viewType = ImageViewType::e2D;
+		viewInfo.format = Format::eR32Sfloat;
+		viewInfo.subresourceRange = ImageSubresourceRange{ ImageAspectFlagBits::eColor, 0, levelCount, 0, 1 };
+		m_depthPyramidView = raii::ImageView{ m_device, viewInfo };
+
+		for (uint32_t level = 0; level < levelCount; level++)
+		{
+			viewInfo.subresourceRange = ImageSubresourceRange{ ImageAspectFlagBits::eColor, level, 1, 0, 1 };
+			m_depthPyramidLevelViews.emplace_back(m_device, viewInfo);
+		}
+
+		// Lives in the general layout for good, it is written as a storage image and read as a sampled one
+		unique_ptr<raii::CommandBuffer> commandBuffer = BeginSingleTimeCommands();
+
+		const ImageSubresourceRange pyramidRange{ ImageAspectFlagBits::eColor, 0, levelCount, 0, 1 };
+
+		ImageMemoryBarrier2 barrier{};
+		barrier.srcStageMask = PipelineStageFlagBits2::eTopOfPipe;
+		barrier.dstStageMask = PipelineStageFlagBits2::eClear;
+		barrier.dstAccessMask = AccessFlagBits2::eTransferWrite;
+		barrier.oldLayout = ImageLayout::eUndefined;
+		barrier.newLayout = ImageLayout::eGeneral;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = *m_depthPyramid;
+		barrier.subresourceRange = pyramidRange;
+
+		DependencyInfo dependencyInfo{};
+		dependencyInfo.imageMemoryBarrierCount = 1;
+		dependencyInfo.pImageMemoryBarriers = &barrier;
+		commandBuffer->pipelineBarrier2(dependencyInfo);
+
+		commandBuffer->clearColorImage(*m_depthPyramid, ImageLayout::eGeneral, ClearColorValue{ array<float, 4>{ 1.0f, 1.0f, 1.0f, 1.0f } }, pyramidRange);
+
+		barrier.srcStageMask = PipelineStageFlagBits2::eClear;
+		barrier.srcAccessMask = AccessFlagBits2::eTransferWrite;
+		barrier.dstStageMask = PipelineStageFlagBits2::eComputeShader;
+		barrier.dstAccessMask = AccessFlagBits2::eShaderSampledRead | AccessFlagBits2::eShaderStorageWrite;
+		barrier.oldLayout = ImageLayout::eGeneral;
+		commandBuffer->pipelineBarrier2(dependencyInfo);
+
+		EndSingleTimeCommands(*commandBuffer);
+
+		if (!m_pushDescriptorSupported)
+		{
+			array<DescriptorPoolSize, 2> poolSizes{};
+			poolSizes[0].type = DescriptorType::eSampledImage;
+			poolSizes[0].descriptorCount = levelCount;
+			poolSizes[1].type = DescriptorType::eStorageImage;
+			poolSizes[1].descriptorCount = levelCount;
+
+			DescriptorPoolCreateInfo poolInfo{};
+			poolInfo.flags = DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+			poolInfo.maxSets = levelCount;
+			poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+			poolInfo.pPoolSizes = poolSizes.data();
+
+			m_pyramidDescriptorPool = raii::DescriptorPool{ m_device, poolInfo };
+
+			vector<DescriptorSetLayout> layouts(levelCount, m_pyramidDescriptorSetLayout);
+			DescriptorSetAllocateInfo setAllocInfo{};
+			setAllocInfo.descriptorPool = *m_pyramidDescriptorPool;
+			setAllocInfo.descriptorSetCount = levelCount;
+			setAllocInfo.pSetLayouts = layouts.data();
+
+			m_pyramidDescriptorSets = m_device.allocateDescriptorSets(setAllocInfo);
+
+			for (uint32_t level = 0; level < levelCount; level++) m_descriptorWriter.WriteSet(*m_pyramidDescriptorSets[level], m_pyramidDescriptorTemplate, GetPyramidDescriptors(level));
+		}
+
+		// The cull sets outlive the pyramid, which is recreated with the swap chain
+		if (!m_cullDescriptorSets.empty()) WriteCullDescriptors();
+		m_descriptorWriter.Flush();
+	}
+
+	// Level 0 reads the depth buffer, every other level the one before it
+	array<DescriptorData, 2> GetPyramidDescriptors(uint32_t level) const
+	{
+		return
+		{
+			ImageDescriptor(level == 0 ? *m_depthImageView : *m_depthPyramidLevelViews[level - 1], level == 0 ? ImageLayout::eShaderReadOnlyOptimal : ImageLayout::eGeneral),
+			ImageDescriptor(*m_depthPyramidLevelViews[level], ImageLayout::eGeneral)
+		};
+	}
+
 	Format FindDepthFormat()
 	{
 		return FindSupportedFormat
 		(
 			{ Format::eD32Sfloat, Format::eD32SfloatS8Uint, Format::eD24UnormS8Uint },
 			ImageTiling::eOptimal,
-			FormatFeatureFlagBits::eDepthStencilAttachment
+			FormatFeatureFlagBits::eDepthStencilAttachment | FormatFeatureFlagBits::eSampledImage
 		);
 	}
 
@@ -871,76 +1653,551 @@ class HelloTriangleApplication
 		EndSingleTimeCommands(*commandBuffer);
 	}
 
-	void CreateVertexBuffer()
+	void CreateGeometryPool()
 	{
-		DeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-		raii::Buffer stagingBuffer({});
-		raii::DeviceMemory stagingBufferMemory({});
-		CreateBuffer(stagingBuffer, stagingBufferMemory, bufferSize, BufferUsageFlagBits::eTransferSrc, MemoryPropertyFlagBits::eHostVisible | MemoryPropertyFlagBits::eHostCoherent);
-
-		void* dataStaging = stagingBufferMemory.mapMemory(0, bufferSize);
-		memcpy(dataStaging, vertices.data(), static_cast<size_t>(bufferSize));
-		stagingBufferMemory.unmapMemory();
+		CreateBuffer
+		(
+			m_geometryVertexBuffer,
+			m_geometryVertexBufferMemory,
+			GEOMETRY_POOL_VERTEX_COUNT * sizeof(Vertex),
+			BufferUsageFlagBits::eTransferDst | BufferUsageFlagBits::eVertexBuffer | BufferUsageFlagBits::eStorageBuffer,
+			MemoryPropertyFlagBits::eDeviceLocal
+		);
+		CreateBuffer
+		(
+			m_geometryIndexBuffer,
+			m_geometryIndexBufferMemory,
+			GEOMETRY_POOL_INDEX_BYTES,
+			BufferUsageFlagBits::eTransferDst | BufferUsageFlagBits::eIndexBuffer,
+			MemoryPropertyFlagBits::eDeviceLocal
+		);
 
-		CreateBuffer(m_vertexBuffer, m_vertexBufferMemory, bufferSize, BufferUsageFlagBits::eTransferDst | BufferUsageFlagBits::eVertexBuffer, MemoryPropertyFlagBits::eDeviceLocal);
-		CopyBuffer(stagingBuffer, m_vertexBuffer, bufferSize);
+		m_vertexAllocator.Reset(GEOMETRY_POOL_VERTEX_COUNT);
+		m_indexAllocator.Reset(GEOMETRY_POOL_INDEX_BYTES);
 	}
 
-	void CreateIndexBuffer()
+	MeshRange UploadMesh(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount, uint32_t indexSize)
 	{
-		DeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+		const DeviceSize vertexBytes = sizeof(Vertex) * vertexCount;
+		const DeviceSize indexBytes = static_cast<DeviceSize>(indexSize) * indexCount;
+
+		optional<uint64_t> vertexOffset = m_vertexAllocator.Allocate(vertexCount);
+		if (!vertexOffset) throw runtime_error("geometry pool is out of vertex space!");
+
+		// Index ranges stay 4 byte aligned so any index type can be bound at offset 0
+		optional<uint64_t> indexOffset = m_indexAllocator.Allocate(indexBytes, 4);
+		if (!indexOffset)
+		{
+			m_vertexAllocator.Free(*vertexOffset, vertexCount);
+			throw runtime_error("geometry pool is out of index space!");
+		}
+
 		raii::Buffer stagingBuffer({});
 		raii::DeviceMemory stagingBufferMemory({});
-		CreateBuffer(stagingBuffer, stagingBufferMemory, bufferSize, BufferUsageFlagBits::eTransferSrc, MemoryPropertyFlagBits::eHostVisible | MemoryPropertyFlagBits::eHostCoherent);
+		CreateBuffer(stagingBuffer, stagingBufferMemory, vertexBytes + indexBytes, BufferUsageFlagBits::eTransferSrc, MemoryPropertyFlagBits::eHostVisible | MemoryPropertyFlagBits::eHostCoherent);
 
-		void* data = stagingBufferMemory.mapMemory(0, bufferSize);
-		memcpy(data, indices.data(), static_cast<size_t>(bufferSize));
+		char* dataStaging = static_cast<char*>(stagingBufferMemory.mapMemory(0, vertexBytes + indexBytes));
+		memcpy(dataStaging, vertexData, static_cast<size_t>(vertexBytes));
+		memcpy(dataStaging + vertexBytes, indexData, static_cast<size_t>(indexBytes));
 		stagingBufferMemory.unmapMemory();
 
-		CreateBuffer(m_indexBuffer, m_indexBufferMemory, bufferSize, BufferUsageFlagBits::eTransferDst | BufferUsageFlagBits::eIndexBuffer, MemoryPropertyFlagBits::eDeviceLocal);
-		CopyBuffer(stagingBuffer, m_indexBuffer, bufferSize);
+		unique_ptr<raii::CommandBuffer> commandBuffer = BeginSingleTimeCommands();
+		commandBuffer->copyBuffer(*stagingBuffer, *m_geometryVertexBuffer, BufferCopy{ 0, *vertexOffset * sizeof(Vertex), vertexBytes });
+		commandBuffer->copyBuffer(*stagingBuffer, *m_geometryIndexBuffer, BufferCopy{ vertexBytes, *indexOffset, indexBytes });
+		EndSingleTimeCommands(*commandBuffer);
+
+		MeshRange mesh{};
+		mesh.firstIndex = static_cast<uint32_t>(*indexOffset / indexSize);
+		mesh.vertexOffset = static_cast<int32_t>(*vertexOffset);
+		mesh.indexCount = static_cast<uint32_t>(indexCount);
+		mesh.vertexCount = static_cast<uint32_t>(vertexCount);
+		mesh.indexSize = indexSize;
+
+		return mesh;
 	}
 
-	void CreateUniformBuffers()
+	CookedMesh CookMesh(const vector<Vertex>& meshVertices, const vector<uint32_t>& meshIndices)
 	{
-		m_uniformBuffers.clear();
-		m_uniformBuffersMemory.clear();
-		m_uniformBuffersMapped.clear();
+		vector<glm::vec3> positions;
+		vector<float> attributes;
+		positions.reserve(meshVertices.size());
+		attributes.reserve(meshVertices.size() * 5);
+		for (const Vertex& vertex : meshVertices)
+		{
+			positions.push_back(vertex.pos);
+			attributes.insert(attributes.end(), { vertex.col.r, vertex.col.g, vertex.col.b, vertex.UV.x, vertex.UV.y });
+		}
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		vector<LodLevel> chain = MeshSimplifier::BuildLodChain(positions, attributes, 5, 0.5f, meshIndices);
+
+		CookedMesh cooked{};
+		cooked.vertices = meshVertices;
+		cooked.indexSize = ChooseIndexSize(meshVertices.size());
+
+		uint32_t indexCount = 0;
+		for (const LodLevel& level : chain)
 		{
-			constexpr DeviceSize BUFFER_SIZE = sizeof(MatrixUB);
+			cooked.lods.push_back({ indexCount, static_cast<uint32_t>(level.indices.size()), level.error });
+			indexCount += static_cast<uint32_t>(level.indices.size());
+		}
 
-			raii::Buffer uniformBuffer({});
-			raii::DeviceMemory uniformBufferMemory({});
+		cooked.indices.resize(static_cast<size_t>(indexCount) * cooked.indexSize);
+		byte* packed = cooked.indices.data();
+		for (const LodLevel& level : chain)
+		{
+			for (uint32_t index : level.indices)
+			{
+				const uint8_t index8 = static_cast<uint8_t>(index);
+				const uint16_t index16 = static_cast<uint16_t>(index);
+				if (cooked.indexSize == 1) memcpy(packed, &index8, 1);
+				else if (cooked.indexSize == 2) memcpy(packed, &index16, 2);
+				else memcpy(packed, &index, 4);
+				packed += cooked.indexSize;
+			}
+		}
 
-			CreateBuffer(uniformBuffer, uniformBufferMemory, BUFFER_SIZE, BufferUsageFlagBits::eUniformBuffer, MemoryPropertyFlagBits::eHostVisible | MemoryPropertyFlagBits::eHostCoherent);
-			m_uniformBuffers.push_back(move(uniformBuffer));
-			m_uniformBuffersMemory.push_back(move(uniformBufferMemory));
-			m_uniformBuffersMapped.push_back(m_uniformBuffersMemory[i].mapMemory(0, BUFFER_SIZE));
+		glm::vec3 boundsMin = positions.front();
+		glm::vec3 boundsMax = positions.front();
+		for (const glm::vec3& position : positions)
+		{
+			boundsMin = glm::min(boundsMin, position);
+			boundsMax = glm::max(boundsMax, position);
 		}
+		cooked.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+		cooked.boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+
+		return cooked;
 	}
 
-	void CreateDescriptorPool()
+	Mesh CreateMesh(const CookedMesh& cooked)
 	{
-		array<DescriptorPoolSize, 2> poolSizes{};
-		poolSizes[0].type = DescriptorType::eUniformBuffer;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-		poolSizes[1].type = DescriptorType::eCombinedImageSampler;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		Mesh mesh{};
+		mesh.range = UploadMesh(cooked.vertices.data(), cooked.vertices.size(), cooked.indices.data(), cooked.indices.size() / cooked.indexSize, cooked.indexSize);
+		mesh.lods = cooked.lods;
+		mesh.boundsCenter = cooked.boundsCenter;
+		mesh.boundsRadius = cooked.boundsRadius;
 
-		DescriptorPoolCreateInfo poolInfo{};
-		poolInfo.flags = DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
-		poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
-		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-		poolInfo.pPoolSizes = poolSizes.data();
+		return mesh;
+	}
+
+	// Blobs go straight from the mapped file into staging, nothing is parsed
+	Mesh CreateMesh(const MeshCacheView& view)
+	{
+		Mesh mesh{};
+		mesh.range = UploadMesh(view.vertexData, view.header->vertexCount, view.indexData, view.header->indexCount, view.header->indexSize);
+		for (const MeshCacheSubmesh& submesh : view.submeshes) mesh.lods.push_back({ submesh.firstIndex, submesh.indexCount, submesh.error });
+		mesh.boundsCenter = glm::vec3(view.header->boundsCenter[0], view.header->boundsCenter[1], view.header->boundsCenter[2]);
+		mesh.boundsRadius = view.header->boundsRadius;
+
+		return mesh;
+	}
+
+	// Smallest index width that can address every vertex of the mesh
+	uint32_t ChooseIndexSize(size_t vertexCount) const
+	{
+		if (vertexCount <= 0x100 && m_indexTypeUint8Supported) return 1;
+		if (vertexCount <= 0x10000) return 2;
+
+		return 4;
+	}
+
+	static IndexType ToIndexType(uint32_t indexSize)
+	{
+		switch (indexSize)
+		{
+		case 1: return IndexType::eUint8EXT;
+		case 2: return IndexType::eUint16;
+		case 4: return IndexType::eUint32;
+		default: throw invalid_argument("unsupported index size!");
+		}
+	}
+
+	filesystem::path GetMeshCachePath(uint64_t sourceHash, uint32_t part) const
+	{
+		char hashName[17]{};
+		to_chars(hashName, hashName + 16, sourceHash, 16);
+
+		string fileName(hashName);
+		if (part) fileName += "." + to_string(part);
+
+		return filesystem::path(MESH_CACHE_DIRECTORY) / (fileName + ".mesh");
+	}
+
+	// Cooked meshes are keyed by the source content, so edits to the model re-cook and everything else loads from the cache.
+	// Index widths depend on the device and on m_splitLargeMeshes, so a cache cooked under different settings is re-cooked too.
+	vector<Mesh> LoadModel(const string& sourcePath)
+	{
+		MappedFile source(sourcePath);
+		const uint64_t sourceHash = HashBytes(source.Bytes());
+
+		vector<Mesh> meshes;
+		uint32_t partCount = 1;
+		for (uint32_t part = 0; part < partCount; part++)
+		{
+			const filesystem::path cachePath = GetMeshCachePath(sourceHash, part);
+			if (!filesystem::exists(cachePath)) break;
+
+			MappedFile cache(cachePath);
+			MeshCacheView view{};
+			if (!ParseMeshCache(cache.Bytes(), sourceHash, sizeof(Vertex), view)) break;
+			if (!MeshCacheIndicesInRange(view)) break;
+			if (view.header->indexSize != ChooseIndexSize(view.header->vertexCount)) break;
+			if (view.header->partCount > 1 && !m_splitLargeMeshes) break;
+			if (view.header->indexSize == 4 && m_splitLargeMeshes) break;
+
+			partCount = view.header->partCount;
+			meshes.push_back(CreateMesh(view));
+		}
+		if (meshes.size() == partCount) return meshes;
+
+		for (const Mesh& mesh : meshes) FreeMesh(mesh.range);
+		meshes.clear();
+
+		vector<Vertex> meshVertices;
+		vector<uint32_t> meshIndices;
+		ImportObj(string_view(reinterpret_cast<const char*>(source.Data()), source.Size()), meshVertices, meshIndices);
+		if (meshIndices.empty()) throw runtime_error("model has no triangles: " + sourcePath);
+
+		vector<MeshPart<Vertex>> parts;
+		if (m_splitLargeMeshes && meshVertices.size() > 0x10000) parts = SplitMesh(meshVertices, meshIndices);
+		else parts.push_back({ move(meshVertices), move(meshIndices) });
+
+		// Cooking is pure CPU work, only the uploads have to stay on this thread
+		vector<CookedMesh> cookedParts(parts.size());
+		ParallelFor(parts.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t part = begin; part < end; part++) cookedParts[part] = CookMesh(parts[part].vertices, parts[part].indices);
+		});
+
+		for (uint32_t part = 0; part < parts.size(); part++)
+		{
+			const CookedMesh& cooked = cookedParts[part];
+
+			MeshCacheHeader header{};
+			header.sourceHash = sourceHash;
+			header.vertexStride = sizeof(Vertex);
+			header.indexSize = cooked.indexSize;
+			header.vertexCount = static_cast<uint32_t>(cooked.vertices.size());
+			header.indexCount = static_cast<uint32_t>(cooked.indices.size() / cooked.indexSize);
+			header.boundsRadius = cooked.boundsRadius;
+			header.boundsCenter[0] = cooked.boundsCenter.x;
+			header.boundsCenter[1] = cooked.boundsCenter.y;
+			header.boundsCenter[2] = cooked.boundsCenter.z;
+			header.partCount = static_cast<uint32_t>(parts.size());
+			WriteMeshCache(GetMeshCachePath(sourceHash, part), header, cooked.lods, as_bytes(span(cooked.vertices)), span<const byte>(cooked.indices));
+
+			meshes.push_back(CreateMesh(cooked));
+		}
+
+		return meshes;
+	}
+
+	// Minimal Wavefront OBJ reader: positions (with optional vertex colors), texture coordinates and polygon faces
+	static void ImportObj(string_view text, vector<Vertex>& meshVertices, vector<uint32_t>& meshIndices)
+	{
+		vector<glm::vec3> positions;
+		vector<glm::vec3> colors;
+		vector<glm::vec2> texCoords;
+		unordered_map<uint64_t, uint32_t> uniqueVertices;
+		vector<uint32_t> face;
+
+		auto skipSpaces = [](string_view& s) { while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1); };
+		auto parseFloat = [&](string_view& s)
+		{
+			skipSpaces(s);
+			float value = 0.0f;
+			auto [end, error] = from_chars(s.data(), s.data() + s.size(), value);
+			if (error == errc{}) s.remove_prefix(end - s.data());
+			return value;
+		};
+		auto parseIndex = [&](string_view& s, size_t count)
+		{
+			long long value = 0;
+			auto [end, error] = from_chars(s.data(), s.data() + s.size(), value);
+			if (error != errc{}) return -1ll;
+			s.remove_prefix(end - s.data());
+			return value < 0 ? static_cast<long long>(count) + value : value - 1;
+		};
+
+		while (!text.empty())
+		{
+			size_t lineEnd = text.find('\n');
+			string_view line = text.substr(0, lineEnd);
+			text.remove_prefix(lineEnd == string_view::npos ? text.size() : lineEnd + 1);
+			if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+			if (line.starts_with("v "))
+			{
+				line.remove_prefix(2);
+				glm::vec3 position{};
+				for (int i = 0; i < 3; i++) position[i] = parseFloat(line);
+
+				// Vertex colors are the common "x y z r g b" extension, anything else after the position is ignored
+				glm::vec3 color{ 1.0f };
+				float extra[3]{};
+				int extraCount = 0;
+				for (skipSpaces(line); !line.empty() && extraCount < 3; skipSpaces(line)) extra[extraCount++] = parseFloat(line);
+				if (extraCount == 3 && line.empty()) color = glm::vec3(extra[0], extra[1], extra[2]);
+				positions.push_back(position);
+				colors.push_back(color);
+			}
+			else if (line.starts_with("vt "))
+			{
+				line.remove_prefix(3);
+				const float u = parseFloat(line);
+				const float v = parseFloat(line);
+				texCoords.emplace_back(u, 1.0f - v);
+			}
+			else if (line.starts_with("f "))
+			{
+				line.remove_prefix(2);
+				face.clear();
+				while (true)
+				{
+					skipSpaces(line);
+					if (line.empty()) break;
+
+					const long long positionIndex = parseIndex(line, positions.size());
+					long long texCoordIndex = -1;
+					if (!line.empty() && line.front() == '/')
+					{
+						line.remove_prefix(1);
+						if (!line.empty() && line.front() != '/') texCoordIndex = parseIndex(line, texCoords.size());
+					}
+					while (!line.empty() && line.front() != ' ' && line.front() != '\t') line.remove_prefix(1);
+
+					if (positionIndex < 0 || positionIndex >= static_cast<long long>(positions.size())) throw runtime_error("OBJ face references a missing position!");
+					if (texCoordIndex >= static_cast<long long>(texCoords.size())) texCoordIndex = -1;
+
+					const uint64_t key = (static_cast<uint64_t>(positionIndex) << 32) | static_cast<uint32_t>(texCoordIndex);
+					auto [it, inserted] = uniqueVertices.try_emplace(key, static_cast<uint32_t>(meshVertices.size()));
+					if (inserted)
+					{
+						Vertex vertex{};
+						vertex.pos = positions[positionIndex];
+						vertex.col = colors[positionIndex];
+						vertex.UV = texCoordIndex >= 0 ? texCoords[texCoordIndex] : glm::vec2(0.0f);
+						meshVertices.push_back(vertex);
+					}
+					face.push_back(it->second);
+				}
+
+				for (size_t i = 2; i < face.size(); i++) meshIndices.insert(meshIndices.end(), { face[0], face[i - 1], face[i] });
+			}
+		}
+	}
+
+	void FreeMesh(const MeshRange& mesh)
+	{
+		m_vertexAllocator.Free(static_cast<uint64_t>(mesh.vertexOffset), mesh.vertexCount);
+		m_indexAllocator.Free(static_cast<uint64_t>(mesh.firstIndex) * mesh.indexSize, static_cast<uint64_t>(mesh.indexSize) * mesh.indexCount);
+	}
+
+	void CreateUniformBuffers()
+	{
+		m_uniformBuffers.clear();
+		m_uniformBuffersMemory.clear();
+		m_uniformBuffersMapped.clear();
+
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			constexpr DeviceSize BUFFER_SIZE = sizeof(ViewUB);
+
+			raii::Buffer uniformBuffer({});
+			raii::DeviceMemory uniformBufferMemory({});
+
+			CreateBuffer(uniformBuffer, uniformBufferMemory, BUFFER_SIZE, BufferUsageFlagBits::eUniformBuffer, MemoryPropertyFlagBits::eHostVisible | MemoryPropertyFlagBits::eHostCoherent);
+			m_uniformBuffers.push_back(move(uniformBuffer));
+			m_uniformBuffersMemory.push_back(move(uniformBufferMemory));
+			m_uniformBuffersMapped.push_back(m_uniformBuffersMemory[i].mapMemory(0, BUFFER_SIZE));
+		}
+	}
+
+	void CreateInstanceBuffers(uint32_t capacity)
+	{
+		m_instanceBuffersMapped.clear();
+		m_instanceBuffers.clear();
+		m_instanceBuffersMemory.clear();
+
+		const DeviceSize bufferSize = sizeof(InstanceData) * capacity;
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			raii::Buffer instanceBuffer({});
+			raii::DeviceMemory instanceBufferMemory({});
+
+			CreateBuffer(instanceBuffer, instanceBufferMemory, bufferSize, BufferUsageFlagBits::eStorageBuffer, MemoryPropertyFlagBits::eHostVisible | MemoryPropertyFlagBits::eHostCoherent);
+			m_instanceBuffers.push_back(move(instanceBuffer));
+			m_instanceBuffersMemory.push_back(move(instanceBufferMemory));
+			m_instanceBuffersMapped.push_back(static_cast<InstanceData*>(m_instanceBuffersMemory[i].mapMemory(0, bufferSize)));
+		}
+
+		m_instanceCapacity = capacity;
+	}
+
+	// Stages the single descriptor bindings of every frame's set, the bindless arrays are filled by AddBindlessSampler and AddBindlessTexture
+	void WriteFrameDescriptors()
+	{
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			array<DescriptorData, 5> descriptors{};
+			descriptors[0] = BufferDescriptor(*m_uniformBuffers[i], 0, sizeof(ViewUB));
+			descriptors[2] = BufferDescriptor(*m_geometryVertexBuffer);
+			descriptors[3] = BufferDescriptor(*m_instanceBuffers[i]);
+			descriptors[4] = BufferDescriptor(*m_materialBuffer);
+			m_descriptorWriter.WriteSet(*m_descriptorSets[i], m_descriptorTemplate, descriptors);
+		}
+	}
+
+	// Stages every binding of every frame's cull set
+	void WriteCullDescriptors()
+	{
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			const array<DescriptorData, 7> descriptors =
+			{
+				BufferDescriptor(*m_instanceBuffers[i]),
+				BufferDescriptor(*m_gpuMeshBuffer),
+				BufferDescriptor(*m_indirectBuffers[i]),
+				BufferDescriptor(*m_drawCountBuffers[i]),
+				ImageDescriptor(*m_depthPyramidView, ImageLayout::eGeneral),
+				BufferDescriptor(*m_occludedBuffers[i]),
+				BufferDescriptor(*m_objectLodBuffer)
+			};
+			m_descriptorWriter.WriteSet(*m_cullDescriptorSets[i], m_cullDescriptorTemplate, descriptors);
+		}
+	}
+
+	// Per frame in flight, with room for every object in every list. There is a list per cull phase, shader permutation slot
+	// and index slot, so a permutation added later means making them again.
+	void CreateIndirectBuffers()
+	{
+		m_indirectCapacity = static_cast<uint32_t>(max<size_t>(m_renderObjects.size(), 1));
+		m_cullPermutationCount = static_cast<uint32_t>(m_shaderPermutations.size());
+		const DeviceSize listCount = DeviceSize{ CULL_PHASE_COUNT } * m_cullPermutationCount * INDEX_SLOT_COUNT;
+		const DeviceSize indirectBufferSize = sizeof(DrawIndexedIndirectCommand) * m_indirectCapacity * listCount;
+		const DeviceSize drawCountBufferSize = sizeof(uint32_t) * listCount;
+		const DeviceSize occludedBufferSize = sizeof(uint32_t) * m_indirectCapacity;
+
+		m_indirectBuffers.clear();
+		m_indirectBuffersMemory.clear();
+		m_drawCountBuffers.clear();
+		m_drawCountBuffersMemory.clear();
+		m_occludedBuffers.clear();
+		m_occludedBuffersMemory.clear();
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			raii::Buffer indirectBuffer({});
+			raii::DeviceMemory indirectBufferMemory({});
+			CreateBuffer(indirectBuffer, indirectBufferMemory, indirectBufferSize, BufferUsageFlagBits::eStorageBuffer | BufferUsageFlagBits::eIndirectBuffer, MemoryPropertyFlagBits::eDeviceLocal);
+			m_indirectBuffers.push_back(move(indirectBuffer));
+			m_indirectBuffersMemory.push_back(move(indirectBufferMemory));
+
+			raii::Buffer drawCountBuffer({});
+			raii::DeviceMemory drawCountBufferMemory({});
+			CreateBuffer(drawCountBuffer, drawCountBufferMemory, drawCountBufferSize, BufferUsageFlagBits::eStorageBuffer | BufferUsageFlagBits::eIndirectBuffer | BufferUsageFlagBits::eTransferDst, MemoryPropertyFlagBits::eDeviceLocal);
+			m_drawCountBuffers.push_back(move(drawCountBuffer));
+			m_drawCountBuffersMemory.push_back(move(drawCountBufferMemory));
+
+			raii::Buffer occludedBuffer({});
+			raii::DeviceMemory occludedBufferMemory({});
+			CreateBuffer(occludedBuffer, occludedBufferMemory, occludedBufferSize, BufferUsageFlagBits::eStorageBuffer, MemoryPropertyFlagBits::eDeviceLocal);
+			m_occludedBuffers.push_back(move(occludedBuffer));
+			m_occludedBuffersMemory.push_back(move(occludedBufferMemory));
+		}
+
+		// Made again with the rest, every object then starts over at its finest level
+		const DeviceSize objectLodBufferSize = sizeof(uint32_t) * m_indirectCapacity;
+		CreateBuffer(m_objectLodBuffer, m_objectLodBufferMemory, objectLodBufferSize, BufferUsageFlagBits::eStorageBuffer | BufferUsageFlagBits::eTransferDst, MemoryPropertyFlagBits::eDeviceLocal);
+
+		unique_ptr<raii::CommandBuffer> commandBuffer = BeginSingleTimeCommands();
+		commandBuffer->fillBuffer(*m_objectLodBuffer, 0, WholeSize, 0);
+		EndSingleTimeCommands(*commandBuffer);
+	}
+
+	// Per mesh data goes up once, the indirect and count buffers are per frame in flight
+	void CreateGpuCulling()
+	{
+		vector<GpuMesh> gpuMeshes(m_meshes.size());
+		m_indexSlotUsed = {};
+		for (size_t i = 0; i < m_meshes.size(); i++)
+		{
+			const Mesh& mesh = m_meshes[i];
+			GpuMesh& gpuMesh = gpuMeshes[i];
+			gpuMesh.boundsCenter = mesh.boundsCenter;
+			gpuMesh.boundsRadius = mesh.boundsRadius;
+			gpuMesh.firstIndex = mesh.range.firstIndex;
+			gpuMesh.vertexOffset = mesh.range.vertexOffset;
+			gpuMesh.lodCount = static_cast<uint32_t>(min<size_t>(mesh.lods.size(), MAX_GPU_LODS));
+			gpuMesh.indexSlot = static_cast<uint32_t>(countr_zero(mesh.range.indexSize));
+			for (uint32_t lod = 0; lod < gpuMesh.lodCount; lod++) gpuMesh.lods[lod] = { mesh.lods[lod].firstIndex, mesh.lods[lod].indexCount, mesh.lods[lod].error, 0 };
+
+			m_indexSlotUsed[gpuMesh.indexSlot] = true;
+		}
+
+		const DeviceSize meshBufferSize = sizeof(GpuMesh) * max<size_t>(gpuMeshes.size(), 1);
+		raii::Buffer stagingBuffer({});
+		raii::DeviceMemory stagingBufferMemory({});
+		CreateBuffer(stagingBuffer, stagingBufferMemory, meshBufferSize, BufferUsageFlagBits::eTransferSrc, MemoryPropertyFlagBits::eHostVisible | MemoryPropertyFlagBits::eHostCoherent);
+		void* data = stagingBufferMemory.mapMemory(0, meshBufferSize);
+		memcpy(data, gpuMeshes.data(), sizeof(GpuMesh) * gpuMeshes.size());
+		stagingBufferMemory.unmapMemory();
+
+		CreateBuffer(m_gpuMeshBuffer, m_gpuMeshBufferMemory, meshBufferSize, BufferUsageFlagBits::eStorageBuffer | BufferUsageFlagBits::eTransferDst, MemoryPropertyFlagBits::eDeviceLocal);
+		CopyBuffer(stagingBuffer, m_gpuMeshBuffer, meshBufferSize);
+
+		CreateIndirectBuffers();
+
+		array<DescriptorPoolSize, 2> poolSizes{};
+		poolSizes[0].type = DescriptorType::eStorageBuffer;
+		poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 6;
+		poolSizes[1].type = DescriptorType::eSampledImage;
+		poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+
+		DescriptorPoolCreateInfo poolInfo{};
+		poolInfo.flags = DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+		poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+
+		m_cullDescriptorPool = raii::DescriptorPool{ m_device, poolInfo };
+
+		vector<DescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, m_cullDescriptorSetLayout);
+		DescriptorSetAllocateInfo allocInfo{};
+		allocInfo.descriptorPool = *m_cullDescriptorPool;
+		allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+		allocInfo.pSetLayouts = layouts.data();
+
+		m_cullDescriptorSets.clear();
+		m_cullDescriptorSets = m_device.allocateDescriptorSets(allocInfo);
+
+		WriteCullDescriptors();
+		m_descriptorWriter.Flush();
+	}
+
+	void CreateDescriptorPool()
+	{
+		array<DescriptorPoolSize, 4> poolSizes{};
+		poolSizes[0].type = DescriptorType::eUniformBuffer;
+		poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		poolSizes[1].type = DescriptorType::eSampler;
+		poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * MAX_BINDLESS_SAMPLERS;
+		poolSizes[2].type = DescriptorType::eStorageBuffer;
+		poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * 3;
+		poolSizes[3].type = DescriptorType::eSampledImage;
+		poolSizes[3].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * m_bindlessTextureCapacity;
+
+		DescriptorPoolCreateInfo poolInfo{};
+		poolInfo.flags = DescriptorPoolCreateFlagBits::eFreeDescriptorSet | DescriptorPoolCreateFlagBits::eUpdateAfterBind;
+		poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
 
 		m_descriptorPool = raii::DescriptorPool{ m_device, poolInfo };
 	}
 
 	void CreateDescriptorSets()
 	{
-		vector<DescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, *m_descriptorSetLayout);
+		vector<DescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, m_descriptorSetLayout);
 		DescriptorSetAllocateInfo allocInfo{};
 		allocInfo.descriptorPool = *m_descriptorPool;
 		allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
@@ -949,36 +2206,66 @@ class HelloTriangleApplication
 		m_descriptorSets.clear();
 		m_descriptorSets = m_device.allocateDescriptorSets(allocInfo);
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		WriteFrameDescriptors();
+		m_descriptorWriter.Flush();
+	}
+
+	void CreateMaterialBuffer()
+	{
+		constexpr DeviceSize BUFFER_SIZE = sizeof(MaterialData) * MAX_MATERIALS;
+
+		CreateBuffer(m_materialBuffer, m_materialBufferMemory, BUFFER_SIZE, BufferUsageFlagBits::eStorageBuffer, MemoryPropertyFlagBits::eHostVisible | MemoryPropertyFlagBits::eHostCoherent);
+		m_materialBufferMapped = static_cast<MaterialData*>(m_materialBufferMemory.mapMemory(0, BUFFER_SIZE));
+	}
+
+	// Material 0, the loaded texture with the default sampler, used by every object that doesn't pick another
+	void CreateDefaultMaterial()
+	{
+		MaterialData material{};
+		material.sampler = AddBindlessSampler(m_textureSampler);
+		material.baseColorTexture = AddBindlessTexture(m_textureImageView);
+		AddMaterial(material);
+	}
+
+	// Both functions below write into every frame's set. Update after bind makes that legal while older frames are still in flight,
+	// as the slot being written is one none of them can be using yet. The writes are staged and go out with the next frame's flush,
+	// so content streaming in many textures at once costs one update call.
+	uint32_t AddBindlessSampler(const raii::Sampler& sampler)
+	{
+		if (m_bindlessSamplerCount == MAX_BINDLESS_SAMPLERS) throw runtime_error("out of bindless sampler slots!");
+
+		for (const raii::DescriptorSet& descriptorSet : m_descriptorSets) m_descriptorWriter.Write(*descriptorSet, 1, m_bindlessSamplerCount, DescriptorType::eSampler, SamplerDescriptor(*sampler));
+
+		return m_bindlessSamplerCount++;
+	}
+
+	// imageView must be in the shader read only layout whenever a frame that uses it runs
+	uint32_t AddBindlessTexture(const raii::ImageView& imageView)
+	{
+		if (m_bindlessTextureCount == m_bindlessTextureCapacity) throw runtime_error("out of bindless texture slots!");
+
+		const DescriptorData descriptor = ImageDescriptor(*imageView, ImageLayout::eShaderReadOnlyOptimal);
+		for (const raii::DescriptorSet& descriptorSet : m_descriptorSets) m_descriptorWriter.Write(*descriptorSet, 5, m_bindlessTextureCount, DescriptorType::eSampledImage, descriptor);
+
+		return m_bindlessTextureCount++;
+	}
+
+	// Returns the index objects refer to through RenderObject::material.
+	// A permutation no material used before gets its pipelines compiled when first drawn.
+	uint32_t AddMaterial(const MaterialData& material, uint32_t permutation = DEFAULT_SHADER_PERMUTATION)
+	{
+		if (m_materialCount == MAX_MATERIALS) throw runtime_error("out of material slots!");
+
+		auto permutationSlot = ranges::find(m_shaderPermutations, permutation);
+		if (permutationSlot == m_shaderPermutations.end())
 		{
-			constexpr size_t BUFFER_SIZE = sizeof(MatrixUB);
-
-			DescriptorBufferInfo bufferInfo{};
-			bufferInfo.buffer = *m_uniformBuffers[i];
-			bufferInfo.offset = 0;
-			bufferInfo.range = BUFFER_SIZE;
-
-			DescriptorImageInfo imageInfo{};
-			imageInfo.imageLayout = ImageLayout::eShaderReadOnlyOptimal;
-			imageInfo.imageView = *m_textureImageView;
-			imageInfo.sampler = *m_textureSampler;
-
-			array<WriteDescriptorSet, 2> descriptorWrites{};
-			descriptorWrites[0].dstSet = *m_descriptorSets[i];
-			descriptorWrites[0].dstBinding = 0;
-			descriptorWrites[0].dstArrayElement = 0;
-			descriptorWrites[0].descriptorType = DescriptorType::eUniformBuffer;
-			descriptorWrites[0].descriptorCount = 1;
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-			descriptorWrites[1].dstSet = *m_descriptorSets[i];
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorType = DescriptorType::eCombinedImageSampler;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].pImageInfo = &imageInfo;
-
-			m_device.updateDescriptorSets(descriptorWrites, {});
+			if (m_shaderPermutations.size() == MAX_SHADER_PERMUTATIONS) throw runtime_error("out of shader permutation slots!");
+			permutationSlot = m_shaderPermutations.insert(m_shaderPermutations.end(), permutation);
 		}
+		m_materialPermutationSlots.push_back(static_cast<uint32_t>(permutationSlot - m_shaderPermutations.begin()));
+
+		m_materialBufferMapped[m_materialCount] = material;
+		return m_materialCount++;
 	}
 
 	void CreateBuffer
@@ -1073,51 +2360,430 @@ class HelloTriangleApplication
 		m_commandBuffers = raii::CommandBuffers{ m_device, allocInfo };
 	}
 
-	void RecordCommandBuffer(uint32_t imageIndex)
+	// The draw pipelines the path in use binds. Pulled draws fall back to vertex input while theirs compiles.
+	bool IsDrawPipelineInUse(uint32_t pipeline) const
 	{
-		m_commandBuffers[m_currentFrame].begin(CommandBufferBeginInfo{});
+		if (m_gpuDriven) return pipeline == DRAW_PIPELINE_INDIRECT;
+		return pipeline == DRAW_PIPELINE_VERTEX_INPUT || (m_vertexPulling && pipeline == DRAW_PIPELINE_PULLED);
+	}
 
-		TransitionImageLayout
-		(
-			imageIndex,
-			ImageLayout::eUndefined,
-			ImageLayout::eColorAttachmentOptimal,
-			{},
-			AccessFlagBits2::eColorAttachmentWrite,
-			PipelineStageFlagBits2::eTopOfPipe,
-			PipelineStageFlagBits2::eColorAttachmentOutput
-		);
+	// Never waits on a compile, a pipeline that isn't ready stays empty for this frame.
+	// Only the variants the path in use binds are requested, the others would compile for nothing.
+	void ResolveDrawPipelines()
+	{
+		m_drawPipelines.resize(m_shaderPermutations.size() * DRAW_PIPELINE_COUNT);
+		for (uint32_t id = 0; id < m_drawPipelines.size(); id++)
+		{
+			if (!IsDrawPipelineInUse(id % DRAW_PIPELINE_COUNT)) continue;
+
+			GraphicsPipelineDesc desc = m_drawPipelineDescs[id % DRAW_PIPELINE_COUNT];
+			ApplyShaderPermutation(desc, m_shaderPermutations[id / DRAW_PIPELINE_COUNT]);
+			m_drawPipelines[id] = m_pipelineRegistry.Request(desc);
+		}
+	}
+
+	// Everything a draw list needs, set from scratch since secondaries inherit no state.
+	// Batches come sorted by draw key, so pipeline and index width only change between runs and are only bound then.
+	void RecordDraws(const raii::CommandBuffer& commandBuffer, span<const DrawBatch> batches)
+	{
+		commandBuffer.setViewportWithCount(Viewport{ 0.0f, 0.0f, static_cast<float>(m_swapChainExtent.width), static_cast<float>(m_swapChainExtent.height), 0.0f, 1.0f });
+		commandBuffer.setScissorWithCount(Rect2D{ Offset2D{ 0, 0 }, m_swapChainExtent });
+
+		// The layout is shared by every draw pipeline, so the set stays bound across pipeline changes
+		commandBuffer.bindDescriptorSets(PipelineBindPoint::eGraphics, m_pipelineLayout, 0, { *m_descriptorSets[m_currentFrame] }, {});
+
+		uint32_t boundPipeline = ~0u;
+		uint32_t boundIndexSize = 0;
+		bool vertexBufferBound = false;
+		uint64_t bindsSkipped = 0;
+		uint64_t drawsSkipped = 0;
+		for (const DrawBatch& batch : batches)
+		{
+			const Mesh& mesh = m_meshes[batch.mesh];
+			const MeshLod& lod = mesh.lods[batch.lod];
+
+			uint32_t pipeline = batch.pipeline;
+			if (!m_drawPipelines[pipeline] && pipeline % DRAW_PIPELINE_COUNT == DRAW_PIPELINE_PULLED) pipeline = pipeline - DRAW_PIPELINE_PULLED + DRAW_PIPELINE_VERTEX_INPUT;
+			if (!m_drawPipelines[pipeline])
+			{
+				drawsSkipped++;
+				continue;
+			}
+
+			if (pipeline != boundPipeline)
+			{
+				PipelineRegistry::Bind(commandBuffer, m_drawPipelines[pipeline]);
+				boundPipeline = pipeline;
+				if (boundPipeline % DRAW_PIPELINE_COUNT == DRAW_PIPELINE_VERTEX_INPUT && !vertexBufferBound)
+				{
+					commandBuffer.bindVertexBuffers(0, { *m_geometryVertexBuffer }, { 0 });
+					vertexBufferBound = true;
+				}
+			}
+			else bindsSkipped++;
+
+			if (mesh.range.indexSize != boundIndexSize)
+			{
+				commandBuffer.bindIndexBuffer(*m_geometryIndexBuffer, 0, ToIndexType(mesh.range.indexSize));
+				boundIndexSize = mesh.range.indexSize;
+			}
+			else bindsSkipped++;
+
+			// firstInstance stays 0 and the base goes through push constants, so SV_InstanceID means the same on every driver.
+			// With vertex pulling the vertex base goes the same way, so SV_VertexID is just the index, whatever the vertex layout.
+			const DrawPC drawPC{ static_cast<uint32_t>(mesh.range.vertexOffset), batch.firstInstance, mesh.vertexFormat };
+			commandBuffer.pushConstants<DrawPC>(m_pipelineLayout, ShaderStageFlagBits::eVertex, 0, drawPC);
+
+			if (pipeline % DRAW_PIPELINE_COUNT == DRAW_PIPELINE_PULLED) commandBuffer.drawIndexed(lod.indexCount, batch.instanceCount, mesh.range.firstIndex + lod.firstIndex, 0, 0);
+			else commandBuffer.drawIndexed(lod.indexCount, batch.instanceCount, mesh.range.firstIndex + lod.firstIndex, mesh.range.vertexOffset, 0);
+		}
+
+		m_redundantBindsSkipped.fetch_add(bindsSkipped, memory_order_relaxed);
+		if (drawsSkipped) m_drawsSkippedNotReady.fetch_add(drawsSkipped, memory_order_relaxed);
+	}
+
+	// Splits the draw batches into chunks and records each into a secondary from the recording thread's own pool.
+	// The secondaries end up in chunk order, so the result draws exactly like a single inline list.
+	void RecordSecondaryCommandBuffers()
+	{
+		vector<RecordingPool>& framePools = m_recordingPools[m_currentFrame];
+		for (RecordingPool& recordingPool : framePools)
+		{
+			recordingPool.pool.reset();
+			recordingPool.used = 0;
+		}
+
+		const size_t chunkCount = (m_drawBatches.size() + DRAWS_PER_SECONDARY - 1) / DRAWS_PER_SECONDARY;
+		m_secondaryCommandBuffers.resize(chunkCount);
 
+		const Format colorFormat = m_swapChainSurfaceFormat.format;
+
+		CommandBufferInheritanceRenderingInfo inheritanceRenderingInfo{};
+		inheritanceRenderingInfo.colorAttachmentCount = 1;
+		inheritanceRenderingInfo.pColorAttachmentFormats = &colorFormat;
+		inheritanceRenderingInfo.depthAttachmentFormat = m_depthFormat;
+		inheritanceRenderingInfo.rasterizationSamples = SampleCountFlagBits::e1;
+
+		CommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.pNext = &inheritanceRenderingInfo;
+
+		CommandBufferBeginInfo beginInfo{};
+		beginInfo.flags = CommandBufferUsageFlagBits::eOneTimeSubmit | CommandBufferUsageFlagBits::eRenderPassContinue;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+		{
+			RecordingPool& recordingPool = framePools[JobSystem::GetThreadIndex()];
+			for (size_t chunk = begin; chunk < end; chunk++)
+			{
+				if (recordingPool.used == recordingPool.buffers.size())
+				{
+					CommandBufferAllocateInfo allocInfo{};
+					allocInfo.commandPool = recordingPool.pool;
+					allocInfo.level = CommandBufferLevel::eSecondary;
+					allocInfo.commandBufferCount = 1;
+
+					raii::CommandBuffers allocated{ m_device, allocInfo };
+					recordingPool.buffers.push_back(move(allocated.front()));
+				}
+
+				const raii::CommandBuffer& commandBuffer = recordingPool.buffers[recordingPool.used++];
+				const size_t first = chunk * DRAWS_PER_SECONDARY;
+				const size_t count = min(DRAWS_PER_SECONDARY, m_drawBatches.size() - first);
+
+				commandBuffer.begin(beginInfo);
+				RecordDraws(commandBuffer, span<const DrawBatch>(m_drawBatches).subspan(first, count));
+				commandBuffer.end();
+
+				m_secondaryCommandBuffers[chunk] = *commandBuffer;
+			}
+		});
+	}
+
+	// Culls every object on the GPU, leaving compacted indirect draws for the phase ready for RecordIndirectDraws.
+	// Phase 0 clears the counts of both phases and tests against last frame's pyramid, phase 1 retests what phase 0 found occluded.
+	void RecordGpuCulling(uint32_t phase)
+	{
+		const raii::CommandBuffer& commandBuffer = m_commandBuffers[m_currentFrame];
+
+		MemoryBarrier2 inputBarrier{};
+		if (phase == 0)
+		{
+			commandBuffer.fillBuffer(*m_drawCountBuffers[m_currentFrame], 0, WholeSize, 0);
+
+			// Also waits for the pyramid build of the previous frame
+			inputBarrier.srcStageMask = PipelineStageFlagBits2::eClear | PipelineStageFlagBits2::eComputeShader;
+			inputBarrier.srcAccessMask = AccessFlagBits2::eTransferWrite | AccessFlagBits2::eShaderStorageWrite;
+		}
+		else
+		{
+			inputBarrier.srcStageMask = PipelineStageFlagBits2::eComputeShader;
+			inputBarrier.srcAccessMask = AccessFlagBits2::eShaderStorageWrite;
+		}
+		inputBarrier.dstStageMask = PipelineStageFlagBits2::eComputeShader;
+		inputBarrier.dstAccessMask = AccessFlagBits2::eShaderStorageRead | AccessFlagBits2::eShaderStorageWrite | AccessFlagBits2::eShaderSampledRead;
+
+		DependencyInfo inputDependency{};
+		inputDependency.memoryBarrierCount = 1;
+		inputDependency.pMemoryBarriers = &inputBarrier;
+		commandBuffer.pipelineBarrier2(inputDependency);
+
+		CullPC cullPC{};
+		cullPC.viewProj = m_viewProj;
+		cullPC.cameraPosition = glm::vec3(glm::inverse(m_view)[3]);
+		cullPC.pixelsPerWorldUnit = abs(m_proj[1][1]) * static_cast<float>(m_swapChainExtent.height) * 0.5f;
+		cullPC.objectCount = static_cast<uint32_t>(m_renderObjects.size());
+		cullPC.drawCapacity = m_indirectCapacity;
+		cullPC.lodThresholdPixels = LOD_ERROR_THRESHOLD_PIXELS;
+		cullPC.lodHysteresis = LOD_HYSTERESIS;
+		cullPC.phase = phase;
+		cullPC.depthSize = glm::vec2(static_cast<float>(m_swapChainExtent.width), static_cast<float>(m_swapChainExtent.height));
+		cullPC.pyramidLevelCount = m_occlusionCulling ? static_cast<uint32_t>(m_depthPyramidLevelSizes.size()) : 0;
+		cullPC.permutationCount = m_cullPermutationCount;
+
+		commandBuffer.bindPipeline(PipelineBindPoint::eCompute, *m_cullPipeline);
+		commandBuffer.bindDescriptorSets(PipelineBindPoint::eCompute, m_cullPipelineLayout, 1, { *m_cullDescriptorSets[m_currentFrame] }, {});
+		commandBuffer.pushConstants<CullPC>(m_cullPipelineLayout, ShaderStageFlagBits::eCompute, 0, cullPC);
+		commandBuffer.dispatch((cullPC.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+		MemoryBarrier2 cullBarrier{};
+		cullBarrier.srcStageMask = PipelineStageFlagBits2::eComputeShader;
+		cullBarrier.srcAccessMask = AccessFlagBits2::eShaderStorageWrite;
+		cullBarrier.dstStageMask = PipelineStageFlagBits2::eDrawIndirect;
+		cullBarrier.dstAccessMask = AccessFlagBits2::eIndirectCommandRead;
+
+		DependencyInfo cullDependency{};
+		cullDependency.memoryBarrierCount = 1;
+		cullDependency.pMemoryBarriers = &cullBarrier;
+		commandBuffer.pipelineBarrier2(cullDependency);
+	}
+
+	// Every permutation's lists are drawn with that permutation's indirect pipeline
+	void RecordIndirectDraws(const raii::CommandBuffer& commandBuffer, uint32_t phase)
+	{
+		commandBuffer.setViewportWithCount(Viewport{ 0.0f, 0.0f, static_cast<float>(m_swapChainExtent.width), static_cast<float>(m_swapChainExtent.height), 0.0f, 1.0f });
+		commandBuffer.setScissorWithCount(Rect2D{ Offset2D{ 0, 0 }, m_swapChainExtent });
+
+		commandBuffer.bindDescriptorSets(PipelineBindPoint::eGraphics, m_pipelineLayout, 0, { *m_descriptorSets[m_currentFrame] }, {});
+		commandBuffer.bindVertexBuffers(0, { *m_geometryVertexBuffer }, { 0 });
+
+		for (uint32_t permutationSlot = 0; permutationSlot < m_cullPermutationCount; permutationSlot++)
+		{
+			// Culling still runs, the depth pyramid just misses these objects and occludes less
+			const GraphicsPipelineHandle pipeline = m_drawPipelines[DrawPipelineId(DRAW_PIPELINE_INDIRECT, permutationSlot)];
+			if (!pipeline)
+			{
+				m_drawsSkippedNotReady.fetch_add(static_cast<uint64_t>(ranges::count(m_indexSlotUsed, true)), memory_order_relaxed);
+				continue;
+			}
+
+			PipelineRegistry::Bind(commandBuffer, pipeline);
+			for (uint32_t slot = 0; slot < INDEX_SLOT_COUNT; slot++)
+			{
+				if (!m_indexSlotUsed[slot]) continue;
+
+				const uint32_t list = (phase * m_cullPermutationCount + permutationSlot) * INDEX_SLOT_COUNT + slot;
+				commandBuffer.bindIndexBuffer(*m_geometryIndexBuffer, 0, ToIndexType(1u << slot));
+				commandBuffer.drawIndexedIndirectCount
+				(
+					*m_indirectBuffers[m_currentFrame],
+					sizeof(DrawIndexedIndirectCommand) * m_indirectCapacity * list,
+					*m_drawCountBuffers[m_currentFrame],
+					sizeof(uint32_t) * list,
+					m_indirectCapacity,
+					sizeof(DrawIndexedIndirectCommand)
+				);
+			}
+		}
+	}
+
+	void TransitionDepthImage
+	(
+		ImageLayout oldLayout,
+		ImageLayout newLayout,
+		AccessFlags2 srcAccessMask,
+		AccessFlags2 dstAccessMask,
+		PipelineStageFlags2 srcStageMask,
+		PipelineStageFlags2 dstStageMask
+	)
+	{
+		ImageMemoryBarrier2 barrier{};
+		barrier.srcStageMask = srcStageMask;
+		barrier.srcAccessMask = srcAccessMask;
+		barrier.dstStageMask = dstStageMask;
+		barrier.dstAccessMask = dstAccessMask;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = *m_depthImage;
+		barrier.subresourceRange.aspectMask = ImageAspectFlagBits::eDepth;
+		if (HasStencilComponent(m_depthFormat)) barrier.subresourceRange.aspectMask |= ImageAspectFlagBits::eStencil;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		DependencyInfo dependencyInfo{};
+		dependencyInfo.imageMemoryBarrierCount = 1;
+		dependencyInfo.pImageMemoryBarriers = &barrier;
+		m_commandBuffers[m_currentFrame].pipelineBarrier2(dependencyInfo);
+	}
+
+	// One dispatch per level, each waiting for the level it reads. Expects the depth buffer in the shader read layout.
+	void RecordDepthPyramid()
+	{
+		const raii::CommandBuffer& commandBuffer = m_commandBuffers[m_currentFrame];
+
+		// The first cull phase reads the old pyramid that is about to be overwritten
+		MemoryBarrier2 levelBarrier{};
+		levelBarrier.srcStageMask = PipelineStageFlagBits2::eComputeShader;
+		levelBarrier.srcAccessMask = AccessFlagBits2::eShaderStorageWrite;
+		levelBarrier.dstStageMask = PipelineStageFlagBits2::eComputeShader;
+		levelBarrier.dstAccessMask = AccessFlagBits2::eShaderSampledRead | AccessFlagBits2::eShaderStorageWrite;
+
+		DependencyInfo levelDependency{};
+		levelDependency.memoryBarrierCount = 1;
+		levelDependency.pMemoryBarriers = &levelBarrier;
+		commandBuffer.pipelineBarrier2(levelDependency);
+
+		commandBuffer.bindPipeline(PipelineBindPoint::eCompute, *m_pyramidPipeline);
+
+		Extent2D sourceSize = m_swapChainExtent;
+		for (uint32_t level = 0; level < m_depthPyramidLevelSizes.size(); level++)
+		{
+			const Extent2D levelSize = m_depthPyramidLevelSizes[level];
+			const PyramidPC pyramidPC{ { sourceSize.width, sourceSize.height }, { levelSize.width, levelSize.height } };
+
+			if (m_pushDescriptorSupported) DescriptorWriter::PushDescriptorSet(commandBuffer, m_pyramidDescriptorTemplate, m_pyramidPipelineLayout, 2, GetPyramidDescriptors(level));
+			else commandBuffer.bindDescriptorSets(PipelineBindPoint::eCompute, m_pyramidPipelineLayout, 2, { *m_pyramidDescriptorSets[level] }, {});
+			commandBuffer.pushConstants<PyramidPC>(m_pyramidPipelineLayout, ShaderStageFlagBits::eCompute, 0, pyramidPC);
+			commandBuffer.dispatch((levelSize.width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (levelSize.height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+			commandBuffer.pipelineBarrier2(levelDependency);
+
+			sourceSize = levelSize;
+		}
+	}
+
+	void BeginMainRendering(uint32_t imageIndex, AttachmentLoadOp loadOp, RenderingFlags flags)
+	{
 		const ClearValue clearColor = ClearColorValue{ array<float, 4>{ 0.2f, 0.2f, 0.2f, 1.0f } };
+		const ClearValue clearDepth = ClearDepthStencilValue{ 1.0f, 0 };
 
 		RenderingAttachmentInfo colorAttachmentInfo{};
 		colorAttachmentInfo.imageView = *m_swapChainImageViews[imageIndex];
 		colorAttachmentInfo.imageLayout = ImageLayout::eColorAttachmentOptimal;
-		colorAttachmentInfo.loadOp = AttachmentLoadOp::eClear;
+		colorAttachmentInfo.loadOp = loadOp;
 		colorAttachmentInfo.storeOp = AttachmentStoreOp::eStore;
 		colorAttachmentInfo.clearValue = clearColor;
 
+		// Stored because the depth pyramid is built from it
+		RenderingAttachmentInfo depthAttachmentInfo{};
+		depthAttachmentInfo.imageView = *m_depthImageView;
+		depthAttachmentInfo.imageLayout = ImageLayout::eDepthStencilAttachmentOptimal;
+		depthAttachmentInfo.loadOp = loadOp;
+		depthAttachmentInfo.storeOp = AttachmentStoreOp::eStore;
+		depthAttachmentInfo.clearValue = clearDepth;
+
 		RenderingInfo renderingInfo{};
+		renderingInfo.flags = flags;
 		renderingInfo.renderArea.offset = Offset2D{ 0, 0 };
 		renderingInfo.renderArea.extent = m_swapChainExtent;
 		renderingInfo.layerCount = 1;
 		renderingInfo.colorAttachmentCount = 1;
 		renderingInfo.pColorAttachments = &colorAttachmentInfo;
+		renderingInfo.pDepthAttachment = &depthAttachmentInfo;
 
 		m_commandBuffers[m_currentFrame].beginRendering(renderingInfo);
+	}
+
+	// Builds the pyramid from what the first phase drew, then draws whatever the second cull phase finds visible on top of it
+	void RecordOcclusionPhase(uint32_t imageIndex)
+	{
+		TransitionDepthImage
+		(
+			ImageLayout::eDepthStencilAttachmentOptimal,
+			ImageLayout::eShaderReadOnlyOptimal,
+			AccessFlagBits2::eDepthStencilAttachmentWrite,
+			AccessFlagBits2::eShaderSampledRead,
+			PipelineStageFlagBits2::eLateFragmentTests,
+			PipelineStageFlagBits2::eComputeShader
+		);
+
+		RecordDepthPyramid();
+		RecordGpuCulling(1);
+
+		TransitionDepthImage
+		(
+			ImageLayout::eShaderReadOnlyOptimal,
+			ImageLayout::eDepthStencilAttachmentOptimal,
+			{},
+			AccessFlagBits2::eDepthStencilAttachmentRead | AccessFlagBits2::eDepthStencilAttachmentWrite,
+			PipelineStageFlagBits2::eComputeShader,
+			PipelineStageFlagBits2::eEarlyFragmentTests | PipelineStageFlagBits2::eLateFragmentTests
+		);
+
+		// Separate rendering instances aren't ordered against each other like draws inside one are
+		MemoryBarrier2 colorBarrier{};
+		colorBarrier.srcStageMask = PipelineStageFlagBits2::eColorAttachmentOutput;
+		colorBarrier.srcAccessMask = AccessFlagBits2::eColorAttachmentWrite;
+		colorBarrier.dstStageMask = PipelineStageFlagBits2::eColorAttachmentOutput;
+		colorBarrier.dstAccessMask = AccessFlagBits2::eColorAttachmentRead | AccessFlagBits2::eColorAttachmentWrite;
+
+		DependencyInfo colorDependency{};
+		colorDependency.memoryBarrierCount = 1;
+		colorDependency.pMemoryBarriers = &colorBarrier;
+		m_commandBuffers[m_currentFrame].pipelineBarrier2(colorDependency);
+
+		BeginMainRendering(imageIndex, AttachmentLoadOp::eLoad, {});
+		RecordIndirectDraws(m_commandBuffers[m_currentFrame], 1);
+		m_commandBuffers[m_currentFrame].endRendering();
+	}
+
+	void RecordCommandBuffer(uint32_t imageIndex)
+	{
+		ResolveDrawPipelines();
+
+		const bool parallelRecording = !m_gpuDriven && m_drawBatches.size() >= PARALLEL_RECORDING_MIN_DRAWS;
+		if (parallelRecording) RecordSecondaryCommandBuffers();
+
+		m_commandBuffers[m_currentFrame].begin(CommandBufferBeginInfo{});
+
+		if (m_gpuDriven) RecordGpuCulling(0);
+
+		TransitionImageLayout
+		(
+			imageIndex,
+			ImageLayout::eUndefined,
+			ImageLayout::eColorAttachmentOptimal,
+			{},
+			AccessFlagBits2::eColorAttachmentWrite,
+			PipelineStageFlagBits2::eTopOfPipe,
+			PipelineStageFlagBits2::eColorAttachmentOutput
+		);
 
-		m_commandBuffers[m_currentFrame].bindPipeline(PipelineBindPoint::eGraphics, *m_graphicsPipeline);
+		// Cleared anyway, so the old contents can go. Still has to wait for the previous frame's pyramid build to stop reading it.
+		TransitionDepthImage
+		(
+			ImageLayout::eUndefined,
+			ImageLayout::eDepthStencilAttachmentOptimal,
+			{},
+			AccessFlagBits2::eDepthStencilAttachmentRead | AccessFlagBits2::eDepthStencilAttachmentWrite,
+			PipelineStageFlagBits2::eComputeShader | PipelineStageFlagBits2::eLateFragmentTests,
+			PipelineStageFlagBits2::eEarlyFragmentTests | PipelineStageFlagBits2::eLateFragmentTests
+		);
 
-		m_commandBuffers[m_currentFrame].setViewport(0, Viewport{ 0.0f, 0.0f, static_cast<float>(m_swapChainExtent.width), static_cast<float>(m_swapChainExtent.height), 0.0f, 1.0f });
-		m_commandBuffers[m_currentFrame].setScissor(0, Rect2D{ Offset2D{ 0, 0 }, m_swapChainExtent });
+		BeginMainRendering(imageIndex, AttachmentLoadOp::eClear, parallelRecording ? RenderingFlagBits::eContentsSecondaryCommandBuffers : RenderingFlags{});
 
-		m_commandBuffers[m_currentFrame].bindDescriptorSets(PipelineBindPoint::eGraphics, *m_pipelineLayout, 0, { *m_descriptorSets[m_currentFrame] }, {});
-		m_commandBuffers[m_currentFrame].bindVertexBuffers(0, { *m_vertexBuffer }, { 0 });
-		m_commandBuffers[m_currentFrame].bindIndexBuffer(*m_indexBuffer, 0, IndexTypeValue<decltype(indices)::value_type>::value);
-		m_commandBuffers[m_currentFrame].drawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+		// Short lists aren't worth the hand off, they are recorded inline
+		if (m_gpuDriven) RecordIndirectDraws(m_commandBuffers[m_currentFrame], 0);
+		else if (parallelRecording) m_commandBuffers[m_currentFrame].executeCommands(m_secondaryCommandBuffers);
+		else RecordDraws(m_commandBuffers[m_currentFrame], m_drawBatches);
 
 		m_commandBuffers[m_currentFrame].endRendering();
 
+		if (m_gpuDriven && m_occlusionCulling) RecordOcclusionPhase(imageIndex);
+
 		TransitionImageLayout
 		(
 			imageIndex,
@@ -1183,28 +2849,242 @@ class HelloTriangleApplication
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) m_inFlightFences.emplace_back(m_device, fenceInfo);
 	}
 
-	void UpdateUniformBuffer(uint32_t currentFrame)
+	void UpdateScene()
 	{
 		static chrono::steady_clock::time_point startTime = chrono::high_resolution_clock::now();
 
 		const chrono::steady_clock::time_point currentTime = chrono::high_resolution_clock::now();
 		const float time = chrono::duration<float>(currentTime - startTime).count();
 
-		MatrixUB MUB{};
-		MUB.world = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		MUB.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		MUB.proj = glm::perspective(glm::radians(45.0f), static_cast<float>(m_swapChainExtent.width) / static_cast<float>(m_swapChainExtent.height), 0.1f, 10.0f);
-		MUB.proj[1][1] *= -1.0f;
-		MUB.WVP = MUB.proj * MUB.view * MUB.world;
+		m_scene.SetRotation(m_sceneRoot, glm::angleAxis(time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+		m_scene.Update();
+	}
+
+	// Camera, culling and LOD selection. Touches no GPU resources, so it can run while the previous frame is still in flight.
+	void UpdateView()
+	{
+		m_view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		m_proj = glm::perspective(glm::radians(45.0f), static_cast<float>(m_swapChainExtent.width) / static_cast<float>(m_swapChainExtent.height), CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
+		m_proj[1][1] *= -1.0f;
+		m_viewProj = m_proj * m_view;
+
+		// The GPU culls and picks LODs itself
+		if (m_gpuDriven) return;
+
+		CullObjects(m_viewProj);
+		UpdateLods(m_view, m_proj);
+		BuildDrawBatches();
+	}
+
+	// Sorts the visible objects by draw key so objects with identical state sit next to each other, then gives each run one instanced draw
+	void BuildDrawBatches()
+	{
+		const uint32_t basePipeline = m_vertexPulling ? DRAW_PIPELINE_PULLED : DRAW_PIPELINE_VERTEX_INPUT;
+		auto objectPipeline = [&](const RenderObject& object) { return DrawPipelineId(basePipeline, m_materialPermutationSlots[object.material]); };
+
+		m_renderQueue.Resize(m_visibleObjects.size());
+		ParallelFor(m_visibleObjects.size(), 1024, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const uint32_t objectIndex = m_visibleObjects[i];
+				const RenderObject& object = m_renderObjects[objectIndex];
+				const float depth = (m_viewProj * glm::vec4(m_objectBounds[objectIndex].Center(), 1.0f)).w / CAMERA_FAR_PLANE;
+
+				m_renderQueue.Set(i, DrawKey::Make(object.pass, objectPipeline(object), object.material, object.mesh, object.lod, depth), objectIndex);
+			}
+		});
+		m_renderQueue.Sort();
+
+		m_drawBatches.clear();
+		for (uint32_t i = 0; i < m_renderQueue.Size(); i++)
+		{
+			m_visibleObjects[i] = m_renderQueue.GetItem(i);
+
+			const RenderObject& object = m_renderObjects[m_visibleObjects[i]];
+			const uint32_t pipeline = objectPipeline(object);
+			if (!m_drawBatches.empty())
+			{
+				DrawBatch& batch = m_drawBatches.back();
+				if (batch.pipeline == pipeline && batch.material == object.material && batch.mesh == object.mesh && batch.lod == object.lod)
+				{
+					batch.instanceCount++;
+					continue;
+				}
+			}
+			m_drawBatches.push_back({ pipeline, object.material, object.mesh, object.lod, i, 1 });
+		}
+	}
+
+	// Writes the visible objects' instance data in batch order. Only safe once this frame's fence has signaled.
+	void UpdateInstanceBuffer(uint32_t currentFrame)
+	{
+		const size_t instanceCount = m_gpuDriven ? m_renderObjects.size() : m_visibleObjects.size();
+		if (instanceCount > m_instanceCapacity)
+		{
+			// Rare, so just drain the GPU instead of keeping old buffers alive until their frames retire
+			m_device.waitIdle();
+
+			uint32_t capacity = m_instanceCapacity;
+			while (capacity < instanceCount) capacity *= 2;
+			CreateInstanceBuffers(capacity);
+			WriteFrameDescriptors();
+			if (!m_cullDescriptorSets.empty()) WriteCullDescriptors();
+			m_descriptorWriter.Flush();
+			ranges::fill(m_instanceFramesStale, static_cast<uint8_t>(MAX_FRAMES_IN_FLIGHT));
+		}
+
+		// A material brought a new permutation, whose objects need lists of their own
+		if (m_gpuDriven && m_shaderPermutations.size() > m_cullPermutationCount)
+		{
+			m_device.waitIdle();
+
+			CreateIndirectBuffers();
+			WriteCullDescriptors();
+			m_descriptorWriter.Flush();
+		}
+
+		InstanceData* instances = m_instanceBuffersMapped[currentFrame];
+		if (m_gpuDriven)
+		{
+			// Indexed by object. A moved object is rewritten in each frame's buffer once, static ones cost nothing.
+			m_instanceFramesStale.resize(m_renderObjects.size(), static_cast<uint8_t>(MAX_FRAMES_IN_FLIGHT));
+			ParallelFor(m_renderObjects.size(), 1024, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					const RenderObject& object = m_renderObjects[i];
+					if (m_scene.WasWorldUpdated(object.node)) m_instanceFramesStale[i] = static_cast<uint8_t>(MAX_FRAMES_IN_FLIGHT);
+					if (!m_instanceFramesStale[i]) continue;
+
+					m_instanceFramesStale[i]--;
+					instances[i] = InstanceData::Make(m_scene.GetWorldMatrix(object.node), object.material, object.mesh, m_materialPermutationSlots[object.material], InstanceFlags(static_cast<uint32_t>(i)));
+				}
+			});
+			return;
+		}
+
+		ParallelFor(m_visibleObjects.size(), 1024, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const uint32_t objectIndex = m_visibleObjects[i];
+				const RenderObject& object = m_renderObjects[objectIndex];
+
+				instances[i] = InstanceData::Make(m_scene.GetWorldMatrix(object.node), object.material, object.mesh, m_materialPermutationSlots[object.material], InstanceFlags(objectIndex));
+			}
+		});
+	}
+
+	void UpdateUniformBuffer(uint32_t currentFrame)
+	{
+		// Objects bring their own world matrix through the instance buffer, the vertex shader puts the two together
+		ViewUB viewUB{};
+		viewUB.view = m_view;
+		viewUB.proj = m_proj;
+		viewUB.viewProj = m_viewProj;
+		viewUB.camera = glm::vec4(glm::vec3(glm::inverse(m_view)[3]), 1.0f);
+
+		constexpr size_t BUFFER_SIZE = sizeof(viewUB);
+
+		memcpy(m_uniformBuffersMapped[currentFrame], &viewUB, BUFFER_SIZE);
+	}
+
+	void CullObjects(const glm::mat4& viewProj)
+	{
+		UpdateObjectBounds();
+		m_objectBvh.CullFrustum(Frustum::FromViewProj(viewProj), m_visibleObjects);
+	}
+
+	// World space boxes around every object's bounding sphere, refit into the BVH
+	void UpdateObjectBounds()
+	{
+		m_objectBounds.resize(m_renderObjects.size());
+		ParallelFor(m_renderObjects.size(), 1024, [this](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const Mesh& mesh = m_meshes[m_renderObjects[i].mesh];
+				const glm::mat4& world = m_scene.GetWorldMatrix(m_renderObjects[i].node);
+				const glm::vec3 center = glm::vec3(world * glm::vec4(mesh.boundsCenter, 1.0f));
+				const float worldScale = max({ glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2])) });
+				const glm::vec3 extent(mesh.boundsRadius * worldScale);
+
+				m_objectBounds[i].min = center - extent;
+				m_objectBounds[i].max = center + extent;
+			}
+		});
 
-		constexpr size_t BUFFER_SIZE = sizeof(MUB);
+		m_objectBvh.Update(m_objectBounds);
+	}
+
+	uint32_t InstanceFlags(uint32_t objectIndex) const
+	{
+		return m_pickedObject == objectIndex ? INSTANCE_FLAG_HIGHLIGHTED : 0;
+	}
 
-		memcpy(m_uniformBuffersMapped[currentFrame], &MUB, BUFFER_SIZE);
+	// The GPU driven path only rewrites stale instances, so the objects losing and gaining the highlight are marked stale
+	void SetPickedObject(optional<uint32_t> object)
+	{
+		for (const optional<uint32_t>& changed : { m_pickedObject, object })
+		{
+			if (changed && *changed < m_instanceFramesStale.size()) m_instanceFramesStale[*changed] = static_cast<uint8_t>(MAX_FRAMES_IN_FLIGHT);
+		}
+		m_pickedObject = object;
+	}
+
+	// Casts a ray through a point given in zero to one window coordinates and returns the closest object whose bounds it hits
+	optional<uint32_t> PickObject(float u, float v)
+	{
+		// CPU culling keeps the BVH current every frame, the GPU driven path only needs it here
+		if (m_gpuDriven) UpdateObjectBounds();
+
+		const glm::vec2 ndc(u * 2.0f - 1.0f, v * 2.0f - 1.0f);
+		const glm::mat4 inverseViewProj = glm::inverse(m_viewProj);
+
+		glm::vec4 nearPoint = inverseViewProj * glm::vec4(ndc, 0.0f, 1.0f);
+		glm::vec4 farPoint = inverseViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+		nearPoint /= nearPoint.w;
+		farPoint /= farPoint.w;
+
+		const glm::vec3 direction = glm::vec3(farPoint - nearPoint);
+		const optional<BvhRayHit> hit = m_objectBvh.Raycast(glm::vec3(nearPoint), glm::normalize(direction), glm::length(direction));
+		if (!hit) return nullopt;
+
+		return hit->primitive;
+	}
+
+	void UpdateLods(const glm::mat4& view, const glm::mat4& proj)
+	{
+		const glm::vec3 cameraPosition = glm::vec3(glm::inverse(view)[3]);
+		const float pixelsPerWorldUnit = abs(proj[1][1]) * static_cast<float>(m_swapChainExtent.height) * 0.5f;
+
+		// Only visible objects need a level, hidden ones keep their last one for hysteresis
+		for (uint32_t objectIndex : m_visibleObjects)
+		{
+			RenderObject& object = m_renderObjects[objectIndex];
+			const Mesh& mesh = m_meshes[object.mesh];
+			const glm::mat4& world = m_scene.GetWorldMatrix(object.node);
+			const float worldScale = max({ glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2])) });
+
+			// Object space error -> pixels at distance 1
+			const float pixelsPerUnit = pixelsPerWorldUnit * worldScale;
+			const glm::vec3 center = glm::vec3(world * glm::vec4(mesh.boundsCenter, 1.0f));
+			const float distance = glm::length(center - cameraPosition) - mesh.boundsRadius * worldScale;
+
+			object.lod = SelectLod(mesh.lods, object.lod, distance, pixelsPerUnit, LOD_ERROR_THRESHOLD_PIXELS, LOD_HYSTERESIS);
+		}
 	}
 
 	void DrawFrame()
 	{
+		// The scene and visibility are CPU only, so workers update them while this thread waits for the GPU
+		JobSystem& jobSystem = JobSystem::Get();
+		JobCounter frameUpdate;
+		jobSystem.Schedule([this]() { UpdateScene(); UpdateView(); }, &frameUpdate);
+
 		while (m_device.waitForFences(*m_inFlightFences[m_currentFrame], True, UINT64_MAX) == Result::eTimeout);
+		jobSystem.Wait(frameUpdate);
 
 		auto [result, imageIndex] = m_swapChain.acquireNextImage(UINT64_MAX, *m_presentCompleteSemaphore[m_semaphoreIndex], nullptr);
 
@@ -1212,6 +3092,8 @@ class HelloTriangleApplication
 		else if (result != Result::eSuccess && result != Result::eSuboptimalKHR) throw runtime_error("failed to acquire swap chain image!");
 
 		UpdateUniformBuffer(m_currentFrame);
+		UpdateInstanceBuffer(m_currentFrame);
+		m_descriptorWriter.Flush(); // Bindless slots added since the last frame
 
 		m_device.resetFences(*m_inFlightFences[m_currentFrame]);
 		m_commandBuffers[m_currentFrame].reset();
@@ -1228,6 +3110,7 @@ class HelloTriangleApplication
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = &*m_renderFinishedSemaphore[imageIndex];
 		m_queue.submit(submitInfo, *m_inFlightFences[m_currentFrame]);
+		m_frameCount++;
 
 		PresentInfoKHR presentInfoKHR{};
 		presentInfoKHR.waitSemaphoreCount = 1;
@@ -1259,17 +3142,8 @@ class HelloTriangleApplication
 
 		m_semaphoreIndex = (m_semaphoreIndex + 1) % m_presentCompleteSemaphore.size();
 		m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-	}
-
-	[[nodiscard]] raii::ShaderModule CreateShaderModule(const vector<char>& code) const
-	{
-		ShaderModuleCreateInfo createInfo{};
-		createInfo.codeSize = code.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-		raii::ShaderModule shaderModule{ m_device, createInfo };
 
-		return shaderModule;
+		if (chrono::steady_clock::now() - m_pipelineCacheSavedTime >= PIPELINE_CACHE_SAVE_INTERVAL) SavePipelineCache();
 	}
 
 	static uint32_t ChooseSwapMinImageCount(SurfaceCapabilitiesKHR const& surfaceCapabilities)
@@ -1338,20 +3212,9 @@ class HelloTriangleApplication
 		return False;
 	}
 
-	static vector<char> ReadFile(const string& filename)
-	{
-		ifstream file(filename, ios::ate | ios::binary);
-		if (!file.is_open()) throw runtime_error("failed to open file: " + filename);
-
-		vector<char> buffer(file.tellg());
-		file.seekg(0, ios::beg);
-		file.read(buffer.data(), static_cast<streamsize>(buffer.size()));
-		file.close();
-
-		return buffer;
-	}
-
 public:
+	explicit HelloTriangleApplication(const RendererOptions& options) : m_verbose(options.verbose), m_pipelineBackend(options.pipelineBackend), m_vertexPulling(options.vertexPulling), m_occlusionCulling(options.occlusionCulling) {}
+
 	void Run()
 	{
 		InitWindow();
@@ -1361,9 +3224,46 @@ public:
 	}
 };
 
-int main()
+int main(int argc, char** argv)
 {
-	HelloTriangleApplication app;
+	if (argc > 1 && strcmp(argv[1], "--benchmark-culling") == 0)
+	{
+		constexpr size_t OBJECT_COUNT = 1'000'000;
+		size_t visibleCount = 0;
+		const double objectsPerMicrosecond = BenchmarkFrustumCulling(OBJECT_COUNT, 50, visibleCount);
+		cout << "frustum culling: " << objectsPerMicrosecond << " objects/us (" << visibleCount << " of " << OBJECT_COUNT << " visible)" << endl;
+
+		return EXIT_SUCCESS;
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--benchmark-scene") == 0)
+	{
+		constexpr size_t NODE_COUNT = 100'000;
+		const double milliseconds = BenchmarkSceneUpdate(NODE_COUNT, 100);
+		cout << "scene update: " << milliseconds << " ms per update of " << NODE_COUNT << " nodes" << endl;
+
+		return EXIT_SUCCESS;
+	}
+
+	RendererOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		const string_view option = argv[i];
+		const string_view value = i + 1 < argc ? argv[i + 1] : "";
+		if (option == "--verbose") options.verbose = true;
+		else if (option == "--pipeline-backend" && value == "monolithic") { options.pipelineBackend = PipelineBackend::Monolithic; i++; }
+		else if (option == "--pipeline-backend" && value == "library") { options.pipelineBackend = PipelineBackend::Library; i++; }
+		else if (option == "--pipeline-backend" && value == "shader-object") { options.pipelineBackend = PipelineBackend::ShaderObject; i++; }
+		else if (option == "--vertex-input") options.vertexPulling = false;
+		else if (option == "--no-occlusion") options.occlusionCulling = false;
+		else
+		{
+			cerr << "unknown option: " << argv[i] << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	HelloTriangleApplication app(options);
 
 	try { app.Run(); }
 	catch (const exception& e)